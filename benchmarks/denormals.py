@@ -0,0 +1,98 @@
+"""
+Cost of subnormal numbers, and how well the render paths avoid it.
+
+Run from the repository root:
+
+    python -m benchmarks.denormals [--filter REGEX] [--json results.json]
+
+``subnormal_block_product`` reproduces the slowdown: the oscillator bank's per-block
+product of the state with its output table, once with a state of ordinary magnitude and
+once with one that has decayed into the subnormal range, with the flush-to-zero mode off
+and on. The other benchmarks feed the same decayed states to the library kernels with
+the mode off, as in a host that resets the control register; since they flush their
+states themselves, the decayed cases should run as fast as the ordinary ones.
+"""
+
+import numpy as np
+
+from benchmarks.harness import Case, benchmark, main
+from physics.one_dimensional.harmonic_oscillators import HarmonicOscillatorBank
+from signal_processing.biquad import BlockBiquadCascade, lowpass
+from signal_processing.denormals import (FLUSH_TO_ZERO_SUPPORTED, restore_flush_to_zero,
+                                        set_flush_to_zero)
+
+SAMPLE_RATE = 48000.0
+BLOCK_SIZE = 64
+
+# A magnitude that only subnormal numbers reach
+MAGNITUDES = {"normal": 1e-3, "subnormal": 1e-310}
+
+
+def _with_mode(run, flush_to_zero):
+    """Run ``run`` with the thread's flush-to-zero mode set as requested, then restore it."""
+    def timed():
+        previous = set_flush_to_zero(flush_to_zero)
+        try:
+            run()
+        finally:
+            restore_flush_to_zero(previous)
+    return timed
+
+
+def _bank(modes):
+    rng = np.random.default_rng(0)
+    return HarmonicOscillatorBank(np.sort(rng.uniform(40.0, 0.4 * SAMPLE_RATE, modes)),
+                                  rng.uniform(0.5, 20.0, modes), SAMPLE_RATE,
+                                  output_gains=rng.standard_normal(modes),
+                                  block_size=BLOCK_SIZE)
+
+
+def _decayed(size, state, dtype=np.float64, seed=1):
+    values = np.random.default_rng(seed).uniform(0.5, 1.0, size) * MAGNITUDES[state]
+    if np.dtype(dtype).kind == "c":
+        values = values * np.exp(1j * np.linspace(0.0, 2.0 * np.pi, size))
+    return values.astype(dtype)
+
+
+@benchmark("subnormal_block_product", state=("normal", "subnormal"),
+           flush_to_zero=(False, True) if FLUSH_TO_ZERO_SUPPORTED else (False,))
+def subnormal_block_product(state, flush_to_zero, modes=256):
+    bank = _bank(modes)
+    values = _decayed(modes, state, np.complex128)
+    output = np.empty(BLOCK_SIZE, dtype=np.complex128)
+    # The table is dense and of ordinary magnitude; only the state decays
+    return Case(_with_mode(lambda: np.matmul(values, bank._state_to_output, out=output),
+                           flush_to_zero),
+                {"samples": BLOCK_SIZE, "mode_samples": modes * BLOCK_SIZE},
+                sample_rate=SAMPLE_RATE)
+
+
+@benchmark("decayed_oscillator_bank", state=("normal", "subnormal"), modes=(64, 256))
+def decayed_oscillator_bank(state, modes):
+    bank = _bank(modes)
+    decayed = _decayed(modes, state, np.complex128)
+    block = np.zeros(BLOCK_SIZE)
+
+    def run():
+        np.copyto(bank.state, decayed)
+        bank.process(block)
+    return Case(_with_mode(run, False), {"samples": BLOCK_SIZE, "mode_samples": modes * BLOCK_SIZE},
+                sample_rate=SAMPLE_RATE)
+
+
+@benchmark("decayed_block_biquad", state=("normal", "subnormal"), channels=(16, 64))
+def decayed_block_biquad(state, channels, sections=4):
+    sos = np.stack([lowpass(1000.0 * (k + 1), 0.7, SAMPLE_RATE) for k in range(sections)])
+    cascade = BlockBiquadCascade(sos, channels, block_size=BLOCK_SIZE)
+    decayed = _decayed(cascade.state.size, state).reshape(cascade.state.shape)
+    block = np.zeros((channels, BLOCK_SIZE))
+
+    def run():
+        cascade.state = decayed.copy()
+        cascade.process(block)
+    return Case(_with_mode(run, False), {"samples": channels * BLOCK_SIZE},
+                sample_rate=SAMPLE_RATE)
+
+
+if __name__ == "__main__":
+    main(__doc__.strip().splitlines()[0])
@@ -0,0 +1,211 @@
+"""
+A small microbenchmark harness in the style of Google Benchmark.
+
+Benchmarks are registered with the ``benchmark`` decorator together with a parameter
+grid; the decorated function is a setup that builds the objects under test for one point
+of the grid and returns a ``Case``. The harness calls the case's ``run`` once to warm up,
+then doubles the iteration count until a batch lasts ``min_time``, and times that batch
+``repetitions`` times. Rates are derived from the work counters of the case (samples,
+mode-samples, ...) and the median time per iteration, so a run that was disturbed once
+does not skew the report.
+
+Every benchmark module ends with ``main(description)``, which adds the command line
+(``--filter``, ``--min-time``, ``--repetitions``, ``--json``) and prints a table or
+writes the results with the machine context as JSON.
+"""
+
+import argparse
+import itertools
+import json
+import os
+import platform
+import re
+import statistics
+import subprocess
+import sys
+import time
+from dataclasses import dataclass, field
+
+import numpy as np
+
+
+@dataclass
+class Case:
+    """
+    One configured benchmark.
+
+    Attributes
+    ----------
+    run : callable
+        The timed operation, called without arguments.
+    work : dict
+        Units of work done by one call of ``run`` (e.g. ``{"samples": 64}``); each is
+        reported as a rate per second.
+    sample_rate : float, optional
+        For real-time models: the sample rate that ``work["samples"]`` is rendered at,
+        used to report how many voices run in real time.
+    threads : int, optional
+        Threads the case runs on, to report the real-time voices per core.
+    teardown : callable, optional
+        Called once the case has been timed (e.g. to shut down a thread pool).
+    """
+
+    run: object
+    work: dict
+    sample_rate: float = None
+    threads: int = 1
+    teardown: object = None
+
+
+@dataclass
+class Benchmark:
+    name: str
+    setup: object
+    grid: dict = field(default_factory=dict)
+
+    def points(self):
+        """Parameter dictionaries of the grid, in row-major order."""
+        keys = list(self.grid)
+        for values in itertools.product(*(self.grid[key] for key in keys)):
+            yield dict(zip(keys, values))
+
+
+REGISTRY = []
+
+
+def benchmark(name, **grid):
+    """
+    Register a setup function ``setup(**parameters) -> Case`` under ``name``.
+
+    Every keyword is a sequence of values; the benchmark runs once for every combination,
+    named like ``name/modes:64/threads:2``.
+    """
+    def register(setup):
+        axes = {key: tuple(values) for key, values in grid.items()}
+        REGISTRY.append(Benchmark(name, setup, axes))
+        return setup
+    return register
+
+
+def case_name(name, parameters):
+    return "/".join([name] + [f"{key}:{value}" for key, value in parameters.items()])
+
+
+def _time(run, iterations):
+    start = time.perf_counter()
+    for _ in range(iterations):
+        run()
+    return time.perf_counter() - start
+
+
+def measure(case, min_time=0.2, repetitions=3):
+    """
+    Time a case.
+
+    Returns
+    -------
+    dict
+        Iterations per repetition, median, minimum and standard deviation of the time per
+        iteration in s, and the rates derived from the case's work counters.
+    """
+    case.run()
+    iterations = 1
+    while True:
+        elapsed = _time(case.run, iterations)
+        if elapsed >= min_time or iterations >= 1 << 30:
+            break
+        # Aim straight for the target once the batch is long enough to be timed reliably
+        if elapsed > 0.1 * min_time:
+            iterations = max(int(iterations * 1.2 * min_time / elapsed), iterations + 1)
+        else:
+            iterations *= 2
+    times = [elapsed / iterations]
+    times += [_time(case.run, iterations) / iterations for _ in range(repetitions - 1)]
+    median = statistics.median(times)
+    result = {"iterations": iterations, "repetitions": repetitions,
+              "time_per_iteration": median, "min_time_per_iteration": min(times),
+              "stddev_time_per_iteration": statistics.pstdev(times),
+              "rates": {f"{unit}_per_second": count / median for unit, count in case.work.items()}}
+    if case.sample_rate is not None and "samples" in case.work:
+        voices = case.work["samples"] / median / case.sample_rate
+        result["realtime_voices"] = voices
+        result["realtime_voices_per_core"] = voices / case.threads
+    return result
+
+
+def run_benchmarks(pattern=None, min_time=0.2, repetitions=3, report=None):
+    """
+    Run every registered benchmark whose full name matches the regular expression ``pattern``.
+
+    ``report`` is called with each result as it completes. Returns the list of results.
+    """
+    selected = re.compile(pattern) if pattern else None
+    results = []
+    for entry in REGISTRY:
+        for parameters in entry.points():
+            name = case_name(entry.name, parameters)
+            if selected is not None and not selected.search(name):
+                continue
+            case = entry.setup(**parameters)
+            try:
+                result = {"name": name, "benchmark": entry.name, "parameters": parameters,
+                          **measure(case, min_time, repetitions)}
+            finally:
+                if case.teardown is not None:
+                    case.teardown()
+            results.append(result)
+            if report is not None:
+                report(result)
+    return results
+
+
+def context():
+    """Machine and software description stored next to the results."""
+    try:
+        revision = subprocess.run(["git", "rev-parse", "HEAD"], capture_output=True, text=True,
+                                  cwd=os.path.dirname(os.path.abspath(__file__)),
+                                  check=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        revision = None
+    return {"date": time.strftime("%Y-%m-%dT%H:%M:%S%z"), "host": platform.node(),
+            "machine": platform.machine(), "processor": platform.processor(),
+            "num_cpus": os.cpu_count(), "python": platform.python_version(),
+            "numpy": np.__version__, "revision": revision}
+
+
+def _print_result(result):
+    rates = "  ".join(f"{unit}={value:.4g}" for unit, value in result["rates"].items())
+    voices = result.get("realtime_voices_per_core")
+    voices = f"  voices/core={voices:.1f}" if voices is not None else ""
+    print(f"{result['name']:<56} {1e6 * result['time_per_iteration']:>12.2f} us"
+          f"  {result['iterations']:>8}  {rates}{voices}", flush=True)
+
+
+def main(description, argv=None):
+    """Command line entry point shared by the benchmark modules; returns the results."""
+    parser = argparse.ArgumentParser(description=description)
+    parser.add_argument("--filter", help="regular expression selecting benchmarks by name")
+    parser.add_argument("--min-time", type=float, default=0.2,
+                        help="minimum duration in s of one timed repetition")
+    parser.add_argument("--repetitions", type=int, default=3)
+    parser.add_argument("--json", help="write the results to this file ('-' for stdout)")
+    parser.add_argument("--list", action="store_true", help="list benchmark names and exit")
+    arguments = parser.parse_args(argv)
+
+    if arguments.list:
+        for entry in REGISTRY:
+            for parameters in entry.points():
+                print(case_name(entry.name, parameters))
+        return []
+    quiet = arguments.json == "-"
+    results = run_benchmarks(arguments.filter, arguments.min_time, arguments.repetitions,
+                             report=None if quiet else _print_result)
+    if arguments.json:
+        document = {"context": context(), "benchmarks": results}
+        if quiet:
+            json.dump(document, sys.stdout, indent=1)
+            print()
+        else:
+            with open(arguments.json, "w") as handle:
+                json.dump(document, handle, indent=1)
+    return results
@@ -0,0 +1,163 @@
+"""
+Throughput of the physics models at real-time block sizes.
+
+Run from the repository root:
+
+    python -m benchmarks.physics_models [--filter REGEX] [--json results.json]
+
+Every model is rendered in 64-sample blocks at 48 kHz unless a parameter says otherwise.
+Besides samples per second, modal models report mode-samples per second (modes times
+samples), which stays roughly constant across mode counts while the cost per mode is
+linear, and ``realtime_voices_per_core``, the number of voices of that size one core keeps
+up with. ``oscillator_bank_threads`` renders one independent voice per thread to show how
+throughput scales with threads; NumPy releases the interpreter lock in the block
+products, so it scales until the per-block Python overhead dominates.
+"""
+
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+
+from benchmarks.harness import Case, benchmark, main
+from physics.one_dimensional.bridge_coupling import BridgeCoupling
+from physics.one_dimensional.harmonic_oscillators import HarmonicOscillatorBank
+from physics.one_dimensional.strings import ModalString
+from physics.two_dimensional.multigrid import MultigridSolver
+from physics.two_dimensional.plates import VonKarmanPlate
+from physics.two_dimensional.radiation import GridRadiation, ModalRadiation
+
+SAMPLE_RATE = 48000.0
+BLOCK_SIZE = 64
+
+
+def _bank(num_modes, block_size=BLOCK_SIZE, seed=0):
+    rng = np.random.default_rng(seed)
+    frequencies = np.sort(rng.uniform(40.0, 0.4 * SAMPLE_RATE, num_modes))
+    return HarmonicOscillatorBank(frequencies, rng.uniform(0.5, 20.0, num_modes), SAMPLE_RATE,
+                                  input_gains=rng.standard_normal(num_modes),
+                                  output_gains=rng.standard_normal(num_modes),
+                                  block_size=block_size)
+
+
+def _excitation(size, seed=1):
+    return np.random.default_rng(seed).standard_normal(size)
+
+
+@benchmark("oscillator_bank", modes=(16, 64, 256, 1024), block_size=(32, 64, 128))
+def oscillator_bank(modes, block_size):
+    bank = _bank(modes, block_size)
+    block = _excitation(block_size)
+    return Case(lambda: bank.process(block),
+                {"samples": block_size, "mode_samples": modes * block_size},
+                sample_rate=SAMPLE_RATE)
+
+
+@benchmark("oscillator_bank_step", modes=(16, 64, 256))
+def oscillator_bank_step(modes):
+    bank = _bank(modes)
+    excitation = _excitation(BLOCK_SIZE).tolist()
+
+    def run():
+        for value in excitation:
+            bank.step(value)
+    return Case(run, {"samples": BLOCK_SIZE, "mode_samples": modes * BLOCK_SIZE},
+                sample_rate=SAMPLE_RATE)
+
+
+@benchmark("oscillator_bank_threads", modes=(256, 1024), threads=(1, 2, 4, 8))
+def oscillator_bank_threads(modes, threads, blocks=16):
+    banks = [_bank(modes, seed=seed) for seed in range(threads)]
+    block = _excitation(BLOCK_SIZE)
+    executor = ThreadPoolExecutor(threads)
+
+    def render(bank):
+        # One task renders several blocks so the hand-off cost is amortized, as a voice
+        # thread would run its own block loop
+        for _ in range(blocks):
+            bank.process(block)
+
+    def run():
+        for _ in executor.map(render, banks):
+            pass
+    samples = threads * blocks * BLOCK_SIZE
+    return Case(run, {"samples": samples, "mode_samples": modes * samples},
+                sample_rate=SAMPLE_RATE, threads=threads,
+                teardown=lambda: executor.shutdown(wait=True))
+
+
+@benchmark("modal_string", modes=(32, 128))
+def modal_string(modes):
+    # Low enough that every mode stays below Nyquist
+    string = ModalString(0.65, 60.0, 6e-3, SAMPLE_RATE, num_modes=modes)
+    string.pluck(0.2, 1e-3)
+    block = np.zeros(BLOCK_SIZE)
+    return Case(lambda: string.process(block),
+                {"samples": BLOCK_SIZE, "mode_samples": string.num_modes * BLOCK_SIZE},
+                sample_rate=SAMPLE_RATE)
+
+
+@benchmark("bridge_coupling", strings=(1, 6), string_modes=(32,), body_modes=(64, 256))
+def bridge_coupling(strings, string_modes, body_modes):
+    rng = np.random.default_rng(2)
+    models = [ModalString(0.65, 60.0 * (1.0 + 0.3 * i), 6e-3, SAMPLE_RATE,
+                          num_modes=string_modes) for i in range(strings)]
+    body = _bank(body_modes, seed=3)
+    coupling = BridgeCoupling(models, body, 0.1 * rng.standard_normal((strings, body_modes)))
+    coupling.pluck(0, 0.2, 1e-3)
+    modes = sum(model.num_modes for model in models) + body_modes
+    return Case(lambda: coupling.process(BLOCK_SIZE),
+                {"samples": BLOCK_SIZE, "mode_samples": modes * BLOCK_SIZE},
+                sample_rate=SAMPLE_RATE)
+
+
+@benchmark("von_karman_plate", modes=(25, 100))
+def von_karman_plate(modes):
+    plate = VonKarmanPlate(0.4, 0.3, 1e-3, 7860.0, 2e11, 0.3, modes, SAMPLE_RATE)
+    force = np.zeros(BLOCK_SIZE)
+    force[:8] = 50.0 * np.hanning(8)
+    plate.process(force)
+    block = np.zeros(BLOCK_SIZE)
+    return Case(lambda: plate.process(block),
+                {"samples": BLOCK_SIZE, "mode_samples": modes * BLOCK_SIZE},
+                sample_rate=SAMPLE_RATE)
+
+
+@benchmark("modal_radiation", modes=(25, 100), block_size=(64, 256))
+def modal_radiation(modes, block_size):
+    plate = VonKarmanPlate(0.4, 0.3, 1e-3, 7860.0, 2e11, 0.3, modes, SAMPLE_RATE)
+    positions, area, shapes = plate.surface_grid(24, 18)
+    radiation = ModalRadiation(shapes, positions, area, (0.2, 0.15, 1.0), SAMPLE_RATE,
+                               block_size=block_size)
+    displacements = 1e-6 * _excitation(plate.num_modes * block_size).reshape(-1, block_size)
+    return Case(lambda: radiation.process(displacements),
+                {"samples": block_size, "mode_samples": plate.num_modes * block_size},
+                sample_rate=SAMPLE_RATE)
+
+
+@benchmark("grid_radiation", grid=(32, 64))
+def grid_radiation(grid):
+    x = (np.arange(grid) + 0.5) / grid
+    fx, fy = (values.ravel() for values in np.meshgrid(0.4 * x, 0.3 * x, indexing="ij"))
+    radiation = GridRadiation(np.stack([fx, fy], axis=1), 0.12 / grid**2, (0.2, 0.15, 1.0),
+                              SAMPLE_RATE)
+    velocities = 1e-3 * _excitation(BLOCK_SIZE * grid * grid).reshape(BLOCK_SIZE, -1)
+    return Case(lambda: radiation.process(velocities),
+                {"samples": BLOCK_SIZE, "element_samples": grid * grid * BLOCK_SIZE},
+                sample_rate=SAMPLE_RATE)
+
+
+@benchmark("multigrid_solve", grid=(31, 63, 127))
+def multigrid_solve(grid):
+    # Implicit plate step: mass dominated, as in a time-stepping scheme at 48 kHz
+    spacing = 0.3 / (grid + 1)
+    solver = MultigridSolver((grid, grid), spacing, mass=1.0, stiffness=1e-6,
+                             bending=1e-10)
+    rhs = _excitation(grid * grid).reshape(grid, grid)
+    zeros = np.zeros((grid, grid))
+    # Each call is one time step's solve, started cold so every iteration does equal work
+    return Case(lambda: solver.solve(rhs, initial=zeros),
+                {"solves": 1, "grid_points": grid * grid})
+
+
+if __name__ == "__main__":
+    main(__doc__.strip().splitlines()[0])
@@ -0,0 +1,294 @@
+"""
+Accuracy and performance regression checks against closed-form solutions.
+
+Every check runs a model on a problem with a known analytic answer, reports error norms
+against it, and times the model with the benchmark harness:
+
+* ``damped_oscillator``: impulse responses of single-mode oscillator banks against
+  e^{-sigma t} sin(omega_d t) / omega_d, and a noise-driven bank against the exact
+  convolution, over a second of audio (long enough for drift in the block recursion to
+  show).
+* ``ideal_string``: a lossless, perfectly flexible plucked string against d'Alembert's
+  travelling-wave solution at the pickup over two periods. The error is dominated by the
+  truncation to the modes below Nyquist.
+* ``membrane_mode``: an implicit (theta = 1/4) finite difference membrane, solved with
+  ``MultigridSolver`` every step, started in its (1, 1) mode. The measured frequency is
+  compared with the continuous membrane's and with the scheme's own dispersion relation;
+  the first error is the discretization, the second the solver.
+
+A check fails when an error exceeds the check's absolute limit. With a baseline (written
+by ``--save-baseline`` on the reference machine) it also fails when an error grew by more
+than ``--accuracy-tolerance`` times, or a rate dropped by more than
+``--speed-tolerance``, relative to the baseline. The process exits with status 1 on any
+failure, so the script can gate optimizations such as faster trigonometry, single
+precision or longer time steps:
+
+    python -m benchmarks.regression --save-baseline baseline.json   # before
+    python -m benchmarks.regression --baseline baseline.json        # after
+"""
+
+import argparse
+import json
+import sys
+from dataclasses import dataclass
+
+import numpy as np
+
+from benchmarks.harness import Case, context, measure
+from physics.one_dimensional.harmonic_oscillators import HarmonicOscillatorBank
+from physics.one_dimensional.strings import ModalString
+from physics.two_dimensional.multigrid import MultigridSolver, _laplacian
+
+SAMPLE_RATE = 48000.0
+# Errors this small are rounding noise and never count as a regression
+ACCURACY_FLOOR = 1e-12
+
+
+@dataclass
+class Check:
+    name: str
+    run: object
+    limits: dict
+
+
+CHECKS = []
+
+
+def check(name, **limits):
+    """
+    Register ``run() -> (errors, Case)`` under ``name``.
+
+    ``errors`` maps metric names to error norms; every keyword gives the largest
+    acceptable value of one metric.
+    """
+    def register(run):
+        CHECKS.append(Check(name, run, limits))
+        return run
+    return register
+
+
+def _relative(result, reference):
+    error = result - reference
+    return (float(np.linalg.norm(error) / np.linalg.norm(reference)),
+            float(np.max(np.abs(error)) / np.max(np.abs(reference))))
+
+
+@check("damped_oscillator", impulse_l2=1e-12, impulse_max=1e-12, convolution_l2=1e-12)
+def damped_oscillator():
+    dt = 1.0 / SAMPLE_RATE
+    num_samples = int(SAMPLE_RATE)
+    # Output sample n is the displacement after the update, at t = (n + 1) dt
+    t = np.arange(1, num_samples + 1) * dt
+    impulse = np.zeros(num_samples)
+    impulse[0] = 1.0
+    errors = {"impulse_l2": 0.0, "impulse_max": 0.0}
+    for frequency, decay in ((55.0, 0.5), (440.0, 5.0), (3520.0, 40.0), (15000.0, 300.0)):
+        bank = HarmonicOscillatorBank(frequency, decay, SAMPLE_RATE)
+        omega_d = np.sqrt((2.0 * np.pi * frequency)**2 - decay**2)
+        reference = dt * np.exp(-decay * t) * np.sin(omega_d * t) / omega_d
+        l2, peak = _relative(bank.process(impulse), reference)
+        errors["impulse_l2"] = max(errors["impulse_l2"], l2)
+        errors["impulse_max"] = max(errors["impulse_max"], peak)
+
+    bank = HarmonicOscillatorBank(440.0, 5.0, SAMPLE_RATE)
+    omega_d = np.sqrt((2.0 * np.pi * 440.0)**2 - 25.0)
+    response = dt * np.exp(-5.0 * t) * np.sin(omega_d * t) / omega_d
+    excitation = np.random.default_rng(0).standard_normal(num_samples)
+    errors["convolution_l2"] = _relative(bank.process(excitation),
+                                         np.convolve(excitation, response)[:num_samples])[0]
+
+    rng = np.random.default_rng(1)
+    modes = HarmonicOscillatorBank(np.sort(rng.uniform(40.0, 0.4 * SAMPLE_RATE, 256)),
+                                   rng.uniform(0.5, 20.0, 256), SAMPLE_RATE)
+    block = excitation[:modes.block_size]
+    return errors, Case(lambda: modes.process(block),
+                        {"samples": block.size, "mode_samples": block.size * 256},
+                        sample_rate=SAMPLE_RATE)
+
+
+@check("ideal_string", pickup_l2=2e-3, pickup_max=1e-2)
+def ideal_string():
+    length, linear_density, fundamental = 0.65, 6e-3, 110.0
+    tension = (2.0 * length * fundamental)**2 * linear_density
+    string = ModalString(length, tension, linear_density, SAMPLE_RATE, num_modes=1000,
+                         loss=(0.0, 0.0), pickup_position=0.9)
+    pluck_position, amplitude = 0.2, 1e-3
+    string.pluck(pluck_position, amplitude)
+    num_samples = int(2.0 * SAMPLE_RATE / fundamental)
+    output = string.process(np.zeros(num_samples))
+
+    # d'Alembert: the mean of the odd, 2L-periodic extension of the initial shape
+    # travelling left and right
+    def extension(x):
+        x = np.mod(x, 2.0 * length)
+        sign = np.where(x > length, -1.0, 1.0)
+        x = np.where(x > length, 2.0 * length - x, x)
+        apex = pluck_position * length
+        return sign * amplitude * np.where(x < apex, x / apex, (length - x) / (length - apex))
+
+    t = np.arange(1, num_samples + 1) / SAMPLE_RATE
+    speed = np.sqrt(tension / linear_density)
+    pickup = 0.9 * length
+    reference = 0.5 * (extension(pickup - speed * t) + extension(pickup + speed * t))
+    l2, peak = _relative(output, reference)
+
+    silence = np.zeros(string.oscillators.block_size)
+    return ({"pickup_l2": l2, "pickup_max": peak},
+            Case(lambda: string.process(silence),
+                 {"samples": silence.size, "mode_samples": silence.size * string.num_modes},
+                 sample_rate=SAMPLE_RATE))
+
+
+class _ImplicitMembrane:
+    """
+    Theta-scheme membrane on a grid of interior points with fixed edges:
+    (I - theta c^2 k^2 Laplacian) u+ = 2u - u- + c^2 k^2 Laplacian((1 - 2 theta) u + theta u-).
+    """
+
+    def __init__(self, shape, spacing, wave_speed, sample_rate, theta=0.25):
+        self.spacing = spacing
+        self.theta = theta
+        self.courant = (wave_speed / sample_rate)**2
+        self.solver = MultigridSolver(shape, spacing, mass=1.0, stiffness=theta * self.courant)
+        self.previous = np.zeros(shape)
+        self.current = np.zeros(shape)
+
+    def step(self):
+        theta = self.theta
+        rhs = (2.0 * self.current - self.previous
+               + self.courant * _laplacian((1.0 - 2.0 * theta) * self.current
+                                           + theta * self.previous, self.spacing, self.spacing))
+        new, _ = self.solver.solve(rhs, tolerance=1e-10)
+        self.previous, self.current = self.current, new.copy()
+        return self.current
+
+
+@check("membrane_mode", frequency_error=1e-3, scheme_frequency_error=1e-6)
+def membrane_mode():
+    shape, spacing, wave_speed, num_steps = (63, 31), 0.4 / 64, 100.0, 600
+    width, height = (shape[0] + 1) * spacing, (shape[1] + 1) * spacing
+    dt = 1.0 / SAMPLE_RATE
+    x = np.arange(1, shape[0] + 1) * spacing
+    y = np.arange(1, shape[1] + 1) * spacing
+    mode = np.sin(np.pi * x / width)[:, None] * np.sin(np.pi * y / height)[None, :]
+    omega = wave_speed * np.hypot(np.pi / width, np.pi / height)
+
+    membrane = _ImplicitMembrane(shape, spacing, wave_speed, SAMPLE_RATE)
+    membrane.previous[:] = mode
+    membrane.current[:] = mode * np.cos(omega * dt)
+    # The sampled mode is an eigenvector of the five-point Laplacian, so the grid stays in
+    # it and its amplitude obeys a three-term recurrence
+    amplitudes = np.empty(num_steps)
+    amplitudes[:2] = 1.0, np.cos(omega * dt)
+    norm = np.vdot(mode, mode)
+    for n in range(2, num_steps):
+        amplitudes[n] = np.vdot(mode, membrane.step()) / norm
+    middle = amplitudes[1:-1]
+    cosine = np.dot(middle, amplitudes[2:] + amplitudes[:-2]) / (2.0 * np.dot(middle, middle))
+    measured = np.arccos(cosine) / dt
+
+    # Dispersion relation of the scheme for the discrete eigenvalue of the mode
+    eigenvalue = (4.0 / spacing**2) * (np.sin(0.5 * np.pi * spacing / width)**2
+                                       + np.sin(0.5 * np.pi * spacing / height)**2)
+    stiffness = membrane.courant * eigenvalue
+    theta = membrane.theta
+    predicted = np.arccos((2.0 - (1.0 - 2.0 * theta) * stiffness)
+                          / (2.0 + 2.0 * theta * stiffness)) / dt
+
+    membrane.current[:] = mode
+    return ({"frequency_error": abs(measured / omega - 1.0),
+             "scheme_frequency_error": abs(measured / predicted - 1.0)},
+            Case(membrane.step, {"steps": 1, "grid_points": shape[0] * shape[1]}))
+
+
+def run_checks(pattern=None, min_time=0.2, repetitions=3):
+    """Run the checks whose names contain ``pattern``; returns results by name."""
+    results = {}
+    for entry in CHECKS:
+        if pattern and pattern not in entry.name:
+            continue
+        errors, case = entry.run()
+        timing = measure(case, min_time, repetitions)
+        results[entry.name] = {"errors": errors, "limits": entry.limits, **timing}
+    return results
+
+
+def evaluate(results, baseline=None, accuracy_tolerance=2.0, speed_tolerance=0.25):
+    """
+    Failure messages for the results, against the absolute limits and a baseline.
+
+    Returns an empty list when everything passed.
+    """
+    failures = []
+    for name, result in results.items():
+        for metric, error in result["errors"].items():
+            limit = result["limits"].get(metric)
+            if limit is not None and not error <= limit:
+                failures.append(f"{name}: {metric} = {error:.3g} exceeds the limit {limit:.3g}")
+        previous = (baseline or {}).get(name)
+        if previous is None:
+            continue
+        for metric, error in result["errors"].items():
+            reference = previous["errors"].get(metric)
+            if reference is None:
+                continue
+            allowed = accuracy_tolerance * max(reference, ACCURACY_FLOOR)
+            if not error <= allowed:
+                failures.append(f"{name}: {metric} = {error:.3g} regressed from {reference:.3g}")
+        for unit, rate in result["rates"].items():
+            reference = previous["rates"].get(unit)
+            if reference is not None and rate < (1.0 - speed_tolerance) * reference:
+                failures.append(f"{name}: {unit} = {rate:.4g} regressed from {reference:.4g} "
+                                f"({rate / reference - 1.0:+.0%})")
+    return failures
+
+
+def _print_result(name, result, baseline):
+    previous = (baseline or {}).get(name, {})
+    print(name)
+    for metric, error in result["errors"].items():
+        limit = result["limits"].get(metric)
+        reference = previous.get("errors", {}).get(metric)
+        print(f"  {metric:<28} {error:>12.3e}"
+              + (f"  limit {limit:.1e}" if limit is not None else "")
+              + (f"  baseline {reference:.3e}" if reference is not None else ""))
+    for unit, rate in result["rates"].items():
+        reference = previous.get("rates", {}).get(unit)
+        change = f"  ({rate / reference - 1.0:+.1%} vs baseline)" if reference else ""
+        print(f"  {unit:<28} {rate:>12.4g}{change}")
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0].strip())
+    parser.add_argument("--filter", help="only run checks whose name contains this")
+    parser.add_argument("--baseline", help="compare with the results stored in this file")
+    parser.add_argument("--save-baseline", help="store the results in this file")
+    parser.add_argument("--accuracy-tolerance", type=float, default=2.0,
+                        help="factor an error may grow by relative to the baseline")
+    parser.add_argument("--speed-tolerance", type=float, default=0.25,
+                        help="fraction a rate may drop by relative to the baseline")
+    parser.add_argument("--min-time", type=float, default=0.2,
+                        help="minimum duration in s of one timed repetition")
+    parser.add_argument("--repetitions", type=int, default=3)
+    arguments = parser.parse_args(argv)
+
+    baseline = None
+    if arguments.baseline:
+        with open(arguments.baseline) as handle:
+            baseline = json.load(handle)["checks"]
+    results = run_checks(arguments.filter, arguments.min_time, arguments.repetitions)
+    for name, result in results.items():
+        _print_result(name, result, baseline)
+    if arguments.save_baseline:
+        with open(arguments.save_baseline, "w") as handle:
+            json.dump({"context": context(), "checks": results}, handle, indent=1)
+    failures = evaluate(results, baseline, arguments.accuracy_tolerance,
+                        arguments.speed_tolerance)
+    for failure in failures:
+        print(f"FAIL {failure}")
+    print("FAILED" if failures else "PASSED")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,327 @@
+"""
+Streaming WAV / RF64 writer that keeps file I/O off the render thread.
+
+``AsyncWavWriter.write`` only interleaves a block into one of a fixed set of preallocated
+slots and pushes the slot's index onto an ``SpscQueue``; a dedicated I/O thread converts
+the samples to the file's sample format, gathers them into large chunks and writes the
+chunks, then hands the slot back through a second queue. The render thread never takes
+a lock or waits for the disk unless every slot is still in flight.
+
+The header reserves room for RF64 (EBU Tech 3306): a ``JUNK`` chunk the size of a
+``ds64`` chunk follows the RIFF header, so when the data outgrows the 4 GiB limit of
+32-bit chunk sizes the header is rewritten in place as RF64 on ``close``. The data chunk
+starts at a multiple of the chunk alignment (a second ``JUNK`` chunk pads the header), so
+every chunk write is aligned in memory, in size and in file offset, which is what
+``O_DIRECT`` requires; ``direct=True`` opens the file that way when the platform and file
+system allow it.
+"""
+
+import os
+import struct
+import threading
+import time
+
+import numpy as np
+
+from engine.queues import SpscQueue
+
+_SLOT_DTYPE = np.dtype([("slot", np.int64), ("frames", np.int64)])
+
+# name -> (format tag, bytes per sample)
+SAMPLE_FORMATS = {"int16": (1, 2), "int24": (1, 3), "int32": (1, 4), "float32": (3, 4)}
+
+_EXTENSIBLE = 0xFFFE
+_GUID_TAIL = b"\x00\x00\x00\x00\x10\x00\x80\x00\x00\xaa\x00\x38\x9b\x71"
+_DS64_SIZE = 28
+_RIFF_LIMIT = 0xFFFFFFFF
+
+
+def _aligned_empty(size, alignment):
+    raw = np.empty(size + alignment, dtype=np.uint8)
+    offset = -raw.ctypes.data % alignment
+    return raw[offset:offset + size]
+
+
+def _fmt_chunk(sample_format, num_channels, sample_rate):
+    tag, width = SAMPLE_FORMATS[sample_format]
+    block_align = num_channels * width
+    common = (num_channels, int(sample_rate), int(sample_rate) * block_align, block_align,
+              8 * width)
+    if num_channels <= 2 and sample_format in ("int16", "float32"):
+        return b"fmt " + struct.pack("<IHHIIHH", 16, tag, *common)
+    # WAVE_FORMAT_EXTENSIBLE for multichannel and for PCM wider than 16 bits
+    mask = (1 << num_channels) - 1 if num_channels <= 18 else 0
+    return b"fmt " + struct.pack("<IHHIIHHHHI", 40, _EXTENSIBLE, *common, 22, 8 * width,
+                                 mask) + struct.pack("<H", tag) + _GUID_TAIL
+
+
+def wav_header(sample_format, num_channels, sample_rate, data_size, data_offset, rf64=False):
+    """
+    Header bytes of a WAV file whose data chunk payload starts at ``data_offset``.
+
+    Parameters
+    ----------
+    sample_format : str
+        One of ``SAMPLE_FORMATS``.
+    num_channels : int
+        Interleaved channels.
+    sample_rate : float
+        Sample rate in Hz.
+    data_size : int
+        Bytes of sample data.
+    data_offset : int
+        File offset of the first sample; at least ``min_data_offset(...)``.
+    rf64 : bool, optional
+        Write an RF64 header even if the sizes fit in 32 bits.
+
+    Returns
+    -------
+    bytes
+        Exactly ``data_offset`` bytes.
+    """
+    fmt = _fmt_chunk(sample_format, num_channels, sample_rate)
+    riff_size = data_offset + data_size + (data_size & 1) - 8
+    rf64 = rf64 or riff_size > _RIFF_LIMIT
+    if rf64:
+        frames = data_size // (num_channels * SAMPLE_FORMATS[sample_format][1])
+        reserved = b"ds64" + struct.pack("<IQQQI", _DS64_SIZE, riff_size, data_size, frames, 0)
+        head = b"RF64" + struct.pack("<I", _RIFF_LIMIT) + b"WAVE"
+    else:
+        reserved = b"JUNK" + struct.pack("<I", _DS64_SIZE) + bytes(_DS64_SIZE)
+        head = b"RIFF" + struct.pack("<I", riff_size) + b"WAVE"
+    header = head + reserved + fmt
+    padding = data_offset - len(header) - 8
+    if padding:
+        if padding < 8:
+            raise ValueError("data_offset leaves no room for the header")
+        header += b"JUNK" + struct.pack("<I", padding - 8) + bytes(padding - 8)
+    return header + b"data" + struct.pack("<I", _RIFF_LIMIT if rf64 else data_size)
+
+
+def min_data_offset(sample_format, num_channels):
+    """Smallest data offset ``wav_header`` accepts (no padding chunk)."""
+    return 12 + 8 + _DS64_SIZE + len(_fmt_chunk(sample_format, num_channels, 48000)) + 8
+
+
+class AsyncWavWriter:
+    """
+    WAV / RF64 file written by a background I/O thread.
+
+    Parameters
+    ----------
+    path : str
+        Output file.
+    sample_rate : float
+        Sample rate in Hz.
+    num_channels : int
+        Channels of the blocks passed to ``write``.
+    sample_format : str, optional
+        One of ``SAMPLE_FORMATS``; integer formats clip to [-1, 1].
+    max_block_size : int, optional
+        Frames per slot; longer blocks take several slots.
+    num_slots : int, optional
+        Blocks that can be in flight (a power of two).
+    chunk_size : int, optional
+        Bytes gathered per file write, rounded up to the alignment.
+    alignment : int, optional
+        Alignment of the data offset and of every chunk write.
+    direct : bool, optional
+        Open the file with ``O_DIRECT`` (bypassing the page cache) where supported.
+    rf64 : bool, optional
+        Always write RF64; by default the header only becomes RF64 when needed.
+    poll_interval : float, optional
+        Seconds the I/O thread sleeps when there is nothing to write.
+    """
+
+    def __init__(self, path, sample_rate, num_channels, sample_format="float32",
+                 max_block_size=4096, num_slots=64, chunk_size=1 << 20, alignment=4096,
+                 direct=False, rf64=False, poll_interval=2e-3):
+        if sample_format not in SAMPLE_FORMATS:
+            raise ValueError(f"Unknown sample format {sample_format!r}")
+        self.path = path
+        self.sample_rate = float(sample_rate)
+        self.num_channels = int(num_channels)
+        self.sample_format = sample_format
+        self.max_block_size = int(max_block_size)
+        self.rf64 = rf64
+        self.poll_interval = poll_interval
+        self.frame_size = self.num_channels * SAMPLE_FORMATS[sample_format][1]
+        self.alignment = int(alignment)
+        # Room for the header and a padding chunk, rounded up to the alignment
+        minimum = min_data_offset(sample_format, self.num_channels) + 8
+        self.data_offset = -(-minimum // self.alignment) * self.alignment
+
+        slot_type = np.float32 if sample_format == "float32" else np.float64
+        self._slots = np.zeros((num_slots, self.max_block_size * self.num_channels), slot_type)
+        self._filled = SpscQueue(num_slots, _SLOT_DTYPE)
+        self._free = SpscQueue(num_slots, _SLOT_DTYPE)
+        self._free.push_many(np.array([(slot, 0) for slot in range(num_slots)], _SLOT_DTYPE))
+        self._record = np.zeros(1, _SLOT_DTYPE)
+        self.dropped_frames = 0
+        self.frames_written = 0
+
+        size = -(-max(int(chunk_size), self.data_offset) // self.alignment) * self.alignment
+        self._chunk = _aligned_empty(size, self.alignment)
+        # The first chunk starts with the header (sizes are patched on close)
+        self._chunk[:self.data_offset] = np.frombuffer(
+            wav_header(sample_format, self.num_channels, self.sample_rate, 0, self.data_offset,
+                       rf64), dtype=np.uint8)
+        self._position = self.data_offset
+        flags = os.O_WRONLY | os.O_CREAT | os.O_TRUNC | getattr(os, "O_BINARY", 0)
+        self.direct = False
+        if direct and hasattr(os, "O_DIRECT"):
+            try:
+                self._fd = os.open(path, flags | os.O_DIRECT, 0o644)
+                self.direct = True
+            except OSError:
+                pass
+        if not self.direct:
+            self._fd = os.open(path, flags, 0o644)
+        self._closing = False
+        self._error = None
+        self._thread = threading.Thread(target=self._run, name="wav-writer", daemon=True)
+        self._thread.start()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, kind, error, traceback):
+        self.close()
+        return False
+
+    def _check_error(self):
+        if self._error is not None:
+            raise self._error
+
+    def _acquire_slot(self, wait):
+        while not self._free.pop_into(self._record):
+            if not wait:
+                return -1
+            self._check_error()
+            time.sleep(0)
+        return int(self._record[0]["slot"])
+
+    def write(self, block, wait=True):
+        """
+        Queue a block for writing.
+
+        Parameters
+        ----------
+        block : array_like
+            Samples of shape (channels, frames), or (frames,) for a mono file.
+        wait : bool, optional
+            Wait for a free slot if the I/O thread is behind; otherwise drop what does not
+            fit and count it in ``dropped_frames``.
+
+        Returns
+        -------
+        bool
+            Whether the whole block was queued.
+        """
+        self._check_error()
+        block = np.asarray(block)
+        if block.ndim == 1:
+            block = block[None, :]
+        if block.shape[0] != self.num_channels:
+            raise ValueError(f"Expected {self.num_channels} channels, got {block.shape[0]}")
+        frames = block.shape[1]
+        for start in range(0, frames, self.max_block_size):
+            slot = self._acquire_slot(wait)
+            if slot < 0:
+                self.dropped_frames += frames - start
+                return False
+            count = min(self.max_block_size, frames - start)
+            # Interleave while copying: the slot is read frame by frame
+            interleaved = self._slots[slot, :count * self.num_channels].reshape(count, -1)
+            np.copyto(interleaved, block[:, start:start + count].T, casting="same_kind")
+            self._filled.push((slot, count))
+        return True
+
+    def _encode(self, samples):
+        """File bytes of interleaved samples."""
+        if self.sample_format == "float32":
+            return samples.astype("<f4", copy=False).view(np.uint8)
+        bits = 8 * SAMPLE_FORMATS[self.sample_format][1]
+        scale = float(1 << (bits - 1))
+        values = np.rint(np.clip(samples, -1.0, 1.0) * scale)
+        np.clip(values, -scale, scale - 1.0, out=values)
+        if bits == 16:
+            return values.astype("<i2").view(np.uint8)
+        values = values.astype("<i4")
+        if bits == 24:
+            return values.view(np.uint8).reshape(-1, 4)[:, :3].ravel()
+        return values.view(np.uint8)
+
+    def _write_all(self, data):
+        view = memoryview(data)
+        while view.nbytes:
+            written = os.write(self._fd, view)
+            view = view[written:]
+
+    def _append(self, samples):
+        data = self._encode(samples)
+        chunk = self._chunk
+        while data.size:
+            count = min(data.size, chunk.size - self._position)
+            chunk[self._position:self._position + count] = data[:count]
+            self._position += count
+            data = data[count:]
+            if self._position == chunk.size:
+                self._write_all(chunk)
+                self._position = 0
+
+    def _run(self):
+        record = np.zeros(1, _SLOT_DTYPE)
+        try:
+            while True:
+                if self._filled.pop_into(record):
+                    slot, frames = int(record[0]["slot"]), int(record[0]["frames"])
+                    self._append(self._slots[slot, :frames * self.num_channels])
+                    self.frames_written += frames
+                    self._free.push((slot, 0))
+                elif self._closing and len(self._filled) == 0:
+                    # The flag is set after the last push, so the queue is final once empty
+                    break
+                else:
+                    time.sleep(self.poll_interval)
+            self._finish()
+        except BaseException as error:  # raised on the caller's next write or close
+            self._error = error
+            self._close_fd()
+
+    def _close_fd(self):
+        # -1 once closed, so an error after ``_finish`` closed the file does not close it again
+        if self._fd >= 0:
+            fd, self._fd = self._fd, -1
+            os.close(fd)
+
+    def _finish(self):
+        data_size = self.frames_written * self.frame_size
+        end = self.data_offset + data_size
+        tail = self._position
+        if self.direct:
+            # Direct writes must cover whole aligned blocks; the excess is cut off below
+            padded = -(-tail // self.alignment) * self.alignment
+            self._chunk[tail:padded] = 0
+            tail = padded
+        self._write_all(self._chunk[:tail])
+        os.ftruncate(self._fd, end)
+        self._close_fd()
+        with open(self.path, "r+b") as handle:
+            if data_size & 1:
+                # Chunks are word aligned
+                handle.seek(end)
+                handle.write(b"\0")
+            handle.seek(0)
+            handle.write(wav_header(self.sample_format, self.num_channels, self.sample_rate,
+                                    data_size, self.data_offset, self.rf64))
+
+    def close(self):
+        """Write everything queued, finalize the header and stop the I/O thread."""
+        if self._thread is None:
+            return self.frames_written
+        self._closing = True
+        self._thread.join()
+        self._thread = None
+        self._check_error()
+        return self.frames_written
@@ -0,0 +1,288 @@
+"""
+Block processing graphs whose independent nodes run in parallel.
+
+A ``ProcessingGraph`` holds nodes (exciters, resonators, couplings, effects) and the
+connections between them. Every block, each node runs once after all of its inputs,
+and nodes whose inputs are ready run at the same time on a ``WorkStealingPool``: the
+thread that finishes a node pushes the successors it made ready onto its own deque and
+carries on with the newest of them, which keeps a chain on one core with its data still
+in cache, while idle threads steal the oldest task from someone else's deque. Readiness
+is tracked with one ``itertools.count`` per node, an atomic increment in CPython, so the
+thread completing a node's last input is the one that schedules it and no lock is taken
+on the way.
+
+NumPy releases the interpreter lock inside its array kernels, so nodes whose work is
+dominated by array operations (oscillator banks, grids, convolution) run concurrently.
+
+Given an ``Instrumentation`` (see ``engine.timing``), the graph times every node into
+``node/<name>`` and the whole block into ``graph``, so an overrunning block can be traced
+to the nodes that were slow.
+
+Blocks run with subnormals flushed to zero (see ``signal_processing.denormals``): the
+calling thread for the duration of ``process``, the pool's workers for their lifetime.
+"""
+
+import itertools
+import os
+import threading
+import time
+from collections import deque
+from functools import partial
+
+from signal_processing.denormals import flush_to_zero, set_flush_to_zero
+
+
+class _Run:
+    """State of one ``WorkStealingPool.run`` call, so late workers only see their own run."""
+
+    def __init__(self, num_workers, total):
+        self.deques = [deque() for _ in range(num_workers)]
+        self.total = total
+        self.completed = itertools.count()
+        self.done = threading.Event()
+        # One permit per queued task, so idle workers sleep instead of spinning
+        self.available = threading.Semaphore(0)
+        self.error = None
+
+
+class WorkStealingPool:
+    """
+    A fixed set of worker threads sharing tasks through per-thread deques.
+
+    The thread calling ``run`` takes part as worker 0, so ``num_threads`` extra threads
+    give ``num_threads + 1`` workers in total.
+
+    Parameters
+    ----------
+    num_threads : int
+        Number of background workers.
+    cpus : sequence of int, optional
+        CPUs to pin the background workers to, one per worker (Linux only).
+    """
+
+    def __init__(self, num_threads, cpus=None):
+        self.num_workers = int(num_threads) + 1
+        self._condition = threading.Condition()
+        self._generation = 0
+        self._current = None
+        self._closed = False
+        self._threads = []
+        for index in range(1, self.num_workers):
+            cpu = None if cpus is None else cpus[index - 1]
+            thread = threading.Thread(target=self._worker, args=(index, cpu), daemon=True)
+            thread.start()
+            self._threads.append(thread)
+
+    def _worker(self, index, cpu):
+        if cpu is not None and hasattr(os, "sched_setaffinity"):
+            os.sched_setaffinity(0, {cpu})
+        set_flush_to_zero(True)
+        seen = 0
+        while True:
+            with self._condition:
+                while self._generation == seen and not self._closed:
+                    self._condition.wait()
+                if self._closed:
+                    return
+                seen = self._generation
+                run = self._current
+            self._work(run, index)
+
+    def _next_task(self, run, index):
+        try:
+            return run.deques[index].pop()
+        except IndexError:
+            pass
+        for offset in range(1, self.num_workers):
+            try:
+                return run.deques[(index + offset) % self.num_workers].popleft()
+            except IndexError:
+                continue
+        return None
+
+    def _finish(self, run):
+        run.done.set()
+        # One wake-up per worker; each takes at most one permit after the run is done
+        run.available.release(self.num_workers)
+
+    def _work(self, run, index):
+        own = run.deques[index]
+        while True:
+            run.available.acquire()
+            if run.done.is_set():
+                return
+            # The permit guarantees a task is queued somewhere, though another worker may
+            # take it first and leave us the one it had a permit for.
+            task = self._next_task(run, index)
+            while task is None:
+                time.sleep(0)
+                task = self._next_task(run, index)
+            try:
+                spawned = task()
+            except BaseException as error:  # propagated to the caller of ``run``
+                run.error = error
+                self._finish(run)
+                return
+            if spawned:
+                own.extend(spawned)
+                run.available.release(len(spawned))
+            if next(run.completed) == run.total - 1:
+                self._finish(run)
+
+    def run(self, tasks, total):
+        """
+        Run ``tasks`` and everything they spawn, returning once ``total`` tasks finished.
+
+        A task is a callable returning an iterable of newly ready tasks (or None).
+        """
+        if total == 0:
+            return
+        run = _Run(self.num_workers, total)
+        count = 0
+        for position, task in enumerate(tasks):
+            run.deques[position % self.num_workers].append(task)
+            count += 1
+        run.available.release(count)
+        with self._condition:
+            self._current = run
+            self._generation += 1
+            self._condition.notify_all()
+        self._work(run, 0)
+        run.done.wait()
+        if run.error is not None:
+            raise run.error
+
+    def close(self):
+        """Stop the workers."""
+        with self._condition:
+            self._closed = True
+            self._condition.notify_all()
+        for thread in self._threads:
+            thread.join()
+        self._threads = []
+
+
+class _Node:
+    def __init__(self, index, name, processor, inputs):
+        self.index = index
+        self.name = name
+        self.processor = processor
+        self.inputs = inputs
+        self.successors = []
+        self.output = None
+
+
+class ProcessingGraph:
+    """
+    Directed acyclic graph of block processors.
+
+    Parameters
+    ----------
+    num_threads : int, optional
+        Background workers of the pool; zero runs every node on the calling thread in
+        topological order.
+    cpus : sequence of int, optional
+        CPUs to pin the workers to, see ``WorkStealingPool``.
+    instrumentation : Instrumentation, optional
+        Records the render time of every node and block.
+    """
+
+    def __init__(self, num_threads=0, cpus=None, instrumentation=None):
+        self.instrumentation = instrumentation
+        self.nodes = []
+        self._by_name = {}
+        self._order = None
+        self.pool = WorkStealingPool(num_threads, cpus) if num_threads > 0 else None
+        self._process = (self._process_block if instrumentation is None
+                         else instrumentation.wrap("graph", self._process_block))
+
+    def add_node(self, name, processor, inputs=()):
+        """
+        Add a node.
+
+        Parameters
+        ----------
+        name : str
+            Unique node name.
+        processor : callable
+            Called once per block with the outputs of ``inputs`` (in order) as positional
+            arguments, plus the external block for source nodes that receive one; returns
+            the node's output for the block.
+        inputs : sequence of str, optional
+            Names of the nodes feeding this one; they must already exist, which also
+            rules out cycles.
+        """
+        if name in self._by_name:
+            raise ValueError(f"Node {name!r} already exists")
+        missing = [source for source in inputs if source not in self._by_name]
+        if missing:
+            raise ValueError(f"Unknown input nodes {missing}")
+        if self.instrumentation is not None:
+            processor = self.instrumentation.wrap(f"node/{name}", processor)
+        node = _Node(len(self.nodes), name, processor, [self._by_name[n] for n in inputs])
+        for source in node.inputs:
+            source.successors.append(node)
+        self.nodes.append(node)
+        self._by_name[name] = node
+        self._order = None
+        return node
+
+    @property
+    def order(self):
+        """Nodes in a topological order (insertion order, as inputs must exist first)."""
+        if self._order is None:
+            self._order = list(self.nodes)
+        return self._order
+
+    def output(self, name):
+        """Output of a node for the last processed block."""
+        return self._by_name[name].output
+
+    def _run_node(self, node, external, counters):
+        arguments = [source.output for source in node.inputs]
+        if node.name in external:
+            arguments.append(external[node.name])
+        node.output = node.processor(*arguments)
+        ready = []
+        for successor in node.successors:
+            # The increment that reaches the input count is made by the last input to finish
+            if next(counters[successor.index]) == len(successor.inputs) - 1:
+                ready.append(partial(self._run_node, successor, external, counters))
+        return ready
+
+    def process(self, external=None):
+        """
+        Run every node once.
+
+        Parameters
+        ----------
+        external : dict, optional
+            Blocks passed as an extra last argument to the named nodes (typically sources).
+
+        Returns
+        -------
+        dict
+            Outputs of the sink nodes (those feeding nothing), by name.
+        """
+        with flush_to_zero():
+            return self._process({} if external is None else external)
+
+    def _process_block(self, external):
+        if self.pool is None:
+            for node in self.order:
+                arguments = [source.output for source in node.inputs]
+                if node.name in external:
+                    arguments.append(external[node.name])
+                node.output = node.processor(*arguments)
+        else:
+            counters = [itertools.count() for _ in self.nodes]
+            roots = [partial(self._run_node, node, external, counters)
+                     for node in self.nodes if not node.inputs]
+            self.pool.run(roots, len(self.nodes))
+        return {node.name: node.output for node in self.nodes if not node.successors}
+
+    def close(self):
+        """Stop the worker threads."""
+        if self.pool is not None:
+            self.pool.close()
+            self.pool = None
@@ -0,0 +1,393 @@
+"""
+Declarative instrument descriptions and their compiled, memory-mapped form.
+
+An instrument is described in JSON (or TOML) by its models, the couplings between them
+and their parameters:
+
+    {
+      "name": "piano",
+      "sample_rate": 48000,
+      "block_size": 64,
+      "models": [
+        {"name": "strings", "type": "string", "note_range": [21, 108],
+         "parameters": {"linear_density": 0.006, "num_modes": 64, "inharmonicity": 1e-4},
+         "per_note": {"length": [1.9, ..., 0.05]}},
+        {"name": "soundboard", "type": "modes",
+         "parameters": {"frequencies": [...], "decay_rates": [...]}},
+        {"name": "tone", "type": "filter", "channels": 1,
+         "sections": [{"type": "peaking", "frequency": 250.0, "q": 0.7, "gain_db": 3.0}]}
+      ],
+      "couplings": [
+        {"name": "bridge", "type": "bridge", "strings": "strings", "body": "soundboard",
+         "bridge_shapes": [...]}
+      ]
+    }
+
+Model types are ``string`` (``ModalString``; with ``notes`` or ``note_range`` a group of
+strings whose tension tunes each one to its note, and whose ``per_note`` parameters give
+one value per note), ``plate`` (``VonKarmanPlate``), ``modes`` (a plain
+``HarmonicOscillatorBank``, e.g. a measured body) and ``filter`` (``BlockBiquadCascade``
+from cookbook section designs or raw ``sos`` rows). ``bridge`` couplings attach a string
+group to a ``modes`` body through explicit ``bridge_shapes`` (one row per string, or one
+row for all) or to a ``plate`` at ``points`` given as fractions of its sides.
+
+Building an instrument computes every string's modes and block matrices, plate coupling
+tensors, filter designs and coupling factorizations, which for a full piano takes
+seconds. ``load_instrument`` therefore keeps a compiled file next to the description
+holding all of these arrays: a small JSON header naming each array's dtype, shape and
+offset, followed by the raw data at 64-byte aligned offsets. The file is memory-mapped
+copy-on-write and the models adopt views of it through their ``from_tables``
+constructors, so loading costs a page fault per touched page and no arithmetic, and
+retuning a loaded model writes to private pages rather than the file. The header carries
+a hash of the description, the sample rate and the format version; a compiled file that
+does not match is rebuilt.
+"""
+
+import argparse
+import hashlib
+import json
+import math
+import mmap
+import os
+import struct
+import time
+from dataclasses import dataclass
+
+import numpy as np
+
+from physics.one_dimensional.bridge_coupling import BridgeCoupling
+from physics.one_dimensional.harmonic_oscillators import HarmonicOscillatorBank
+from physics.one_dimensional.strings import ModalString, note_frequency
+from physics.two_dimensional.plates import VonKarmanPlate
+from signal_processing import biquad
+from signal_processing.biquad import BlockBiquadCascade
+
+MAGIC = b"VIRBRAS\0"
+# Bump whenever a model's tables change meaning, so stale compiled files are rebuilt
+FORMAT_VERSION = 5
+ALIGNMENT = 64
+
+_PREAMBLE = struct.Struct("<8sII")  # magic, format version, header length
+
+
+@dataclass
+class Instrument:
+    """
+    Models and couplings built from a description.
+
+    ``models`` maps names to model objects (a list of ``ModalString`` for a string
+    group); ``couplings`` maps names to coupling objects, which share the model objects
+    they connect.
+    """
+
+    name: str
+    sample_rate: float
+    block_size: int
+    models: dict
+    couplings: dict
+
+    def tables(self):
+        """Every model's and coupling's arrays as one nested dictionary."""
+        return {"models": {name: _tables(model) for name, model in self.models.items()},
+                "couplings": {name: _tables(coupling)
+                              for name, coupling in self.couplings.items()}}
+
+
+def _tables(item):
+    if isinstance(item, list):
+        return {str(index): element.tables() for index, element in enumerate(item)}
+    return item.tables()
+
+
+def _string_notes(spec):
+    if "note_range" in spec:
+        first, last = spec["note_range"]
+        return list(range(int(first), int(last) + 1))
+    return spec.get("notes")
+
+
+def _build_string(spec, sample_rate, block_size):
+    parameters = dict(spec.get("parameters", {}))
+    notes = _string_notes(spec)
+    if notes is None:
+        return ModalString(sample_rate=sample_rate, block_size=block_size, **parameters)
+    per_note = spec.get("per_note", {})
+    for name, values in per_note.items():
+        if len(values) != len(notes):
+            raise ValueError(f"per_note {name!r} needs one value per note ({len(notes)})")
+    strings = []
+    for index, note in enumerate(notes):
+        options = dict(parameters, **{name: values[index] for name, values in per_note.items()})
+        if "tension" not in options:
+            # Tension that puts the fundamental on the note
+            options["tension"] = ((2.0 * options["length"] * note_frequency(note))**2
+                                  * options["linear_density"])
+        strings.append(ModalString(sample_rate=sample_rate, block_size=block_size, **options))
+    return strings
+
+
+def _restore_string(spec, tables):
+    if _string_notes(spec) is None:
+        return ModalString.from_tables(tables)
+    return [ModalString.from_tables(tables[str(index)])
+            for index in range(len(_string_notes(spec)))]
+
+
+def _build_plate(spec, sample_rate, block_size):
+    return VonKarmanPlate(sample_rate=sample_rate, block_size=block_size, **spec["parameters"])
+
+
+def _build_modes(spec, sample_rate, block_size):
+    return HarmonicOscillatorBank(sample_rate=sample_rate, block_size=block_size,
+                                  **spec["parameters"])
+
+
+def _section(spec, sample_rate):
+    spec = dict(spec)
+    design = spec.pop("type")
+    if design not in ("peaking", "lowpass", "highpass"):
+        raise ValueError(f"Unknown filter section type {design!r}")
+    return getattr(biquad, design)(sample_rate=sample_rate, **spec)
+
+
+def _build_filter(spec, sample_rate, block_size):
+    if "sos" in spec:
+        sos = spec["sos"]
+    else:
+        sos = np.array([_section(section, sample_rate) for section in spec["sections"]])
+    return BlockBiquadCascade(sos, spec.get("channels", 1), block_size)
+
+
+# type -> (build(spec, sample_rate, block_size), restore(spec, tables))
+MODEL_TYPES = {
+    "string": (_build_string, _restore_string),
+    "plate": (_build_plate, lambda spec, tables: VonKarmanPlate.from_tables(tables)),
+    "modes": (_build_modes, lambda spec, tables: HarmonicOscillatorBank.from_tables(tables)),
+    "filter": (_build_filter, lambda spec, tables: BlockBiquadCascade.from_tables(tables)),
+}
+
+
+def _bridge_parts(spec, models):
+    strings = models[spec["strings"]]
+    strings = strings if isinstance(strings, list) else [strings]
+    body = models[spec["body"]]
+    return strings, body, getattr(body, "oscillators", body)
+
+
+def _build_bridge(spec, models):
+    strings, body, bank = _bridge_parts(spec, models)
+    if "points" in spec:
+        if not isinstance(body, VonKarmanPlate):
+            raise ValueError("Bridge points need a plate body; give bridge_shapes instead")
+        points = np.broadcast_to(np.asarray(spec["points"], dtype=np.float64),
+                                 (len(strings), 2))
+        shapes = body.mode_shapes(points[:, 0], points[:, 1]).T
+        # Plate shapes are normalized by area, so a point force enters divided by rho h
+        return BridgeCoupling(strings, bank, shapes, shapes / body.mass_per_area)
+    shapes = np.broadcast_to(np.asarray(spec["bridge_shapes"], dtype=np.float64),
+                             (len(strings), bank.num_modes))
+    return BridgeCoupling(strings, bank, shapes)
+
+
+def _restore_bridge(spec, tables, models):
+    strings, _, bank = _bridge_parts(spec, models)
+    return BridgeCoupling.from_tables(tables, strings, bank)
+
+
+# type -> (build(spec, models), restore(spec, tables, models))
+COUPLING_TYPES = {
+    "bridge": (_build_bridge, _restore_bridge),
+}
+
+
+def read_description(path):
+    """Parse a description file; ``.toml`` files are read as TOML, anything else as JSON."""
+    if path.endswith(".toml"):
+        import tomllib
+        with open(path, "rb") as handle:
+            return tomllib.load(handle)
+    with open(path) as handle:
+        return json.load(handle)
+
+
+def _entries(description, section, types):
+    entries = description.get(section, [])
+    names = [entry["name"] for entry in entries]
+    if len(set(names)) != len(names):
+        raise ValueError(f"Names in {section!r} must be unique")
+    for entry in entries:
+        if entry["type"] not in types:
+            raise ValueError(f"Unknown {section[:-1]} type {entry['type']!r} "
+                             f"(known: {', '.join(types)})")
+    return entries
+
+
+def _settings(description, sample_rate):
+    rate = float(description["sample_rate"] if sample_rate is None else sample_rate)
+    return rate, int(description.get("block_size", 64))
+
+
+def build_instrument(description, sample_rate=None):
+    """
+    Build an instrument from a parsed description, computing every coefficient.
+
+    Parameters
+    ----------
+    description : dict
+        Parsed description (see the module documentation).
+    sample_rate : float, optional
+        Overrides the description's sample rate.
+    """
+    rate, block_size = _settings(description, sample_rate)
+    models = {}
+    for spec in _entries(description, "models", MODEL_TYPES):
+        models[spec["name"]] = MODEL_TYPES[spec["type"]][0](spec, rate, block_size)
+    couplings = {}
+    for spec in _entries(description, "couplings", COUPLING_TYPES):
+        couplings[spec["name"]] = COUPLING_TYPES[spec["type"]][0](spec, models)
+    return Instrument(description.get("name", ""), rate, block_size, models, couplings)
+
+
+def restore_instrument(description, tables, sample_rate=None):
+    """Rebuild an instrument from its description and compiled tables, without recomputing."""
+    rate, block_size = _settings(description, sample_rate)
+    models = {}
+    for spec in _entries(description, "models", MODEL_TYPES):
+        models[spec["name"]] = MODEL_TYPES[spec["type"]][1](
+            spec, tables["models"][spec["name"]])
+    couplings = {}
+    for spec in _entries(description, "couplings", COUPLING_TYPES):
+        couplings[spec["name"]] = COUPLING_TYPES[spec["type"]][1](
+            spec, tables["couplings"][spec["name"]], models)
+    return Instrument(description.get("name", ""), rate, block_size, models, couplings)
+
+
+def description_key(description, sample_rate=None):
+    """Hash identifying the compiled form of a description at a sample rate."""
+    rate, _ = _settings(description, sample_rate)
+    canonical = json.dumps([FORMAT_VERSION, rate, description], sort_keys=True)
+    return hashlib.sha256(canonical.encode()).hexdigest()
+
+
+def _flatten(tables, prefix=""):
+    for name, value in tables.items():
+        if isinstance(value, dict):
+            yield from _flatten(value, f"{prefix}{name}/")
+        else:
+            yield prefix + name, np.asarray(value, order="C")
+
+
+def _align(offset):
+    return -(-offset // ALIGNMENT) * ALIGNMENT
+
+
+def write_tables(path, tables, key):
+    """
+    Write nested tables of arrays to a compiled file.
+
+    The file is written under a temporary name and renamed, so readers never see a
+    partial file.
+    """
+    arrays = dict(_flatten(tables))
+    entries, offset = {}, 0
+    for name, array in arrays.items():
+        entries[name] = [array.dtype.str, list(array.shape), offset]
+        offset = _align(offset + array.nbytes)
+    header = json.dumps({"key": key, "arrays": entries}).encode()
+    start = _align(_PREAMBLE.size + len(header))
+    temporary = f"{path}.{os.getpid()}.tmp"
+    with open(temporary, "wb") as handle:
+        handle.write(_PREAMBLE.pack(MAGIC, FORMAT_VERSION, len(header)) + header)
+        for name, array in arrays.items():
+            handle.seek(start + entries[name][2])
+            handle.write(array.data)
+        handle.truncate(start + offset)
+    os.replace(temporary, path)
+
+
+def read_tables(path, key=None):
+    """
+    Memory-map a compiled file and return its tables as nested dictionaries of arrays.
+
+    The arrays are plain (writable, copy-on-write) views of the mapping. Returns None if
+    the file is of another format version or was compiled for another ``key``.
+    """
+    with open(path, "rb") as handle:
+        magic, version, size = _PREAMBLE.unpack(handle.read(_PREAMBLE.size))
+        if magic != MAGIC:
+            raise ValueError(f"{path} is not a compiled instrument")
+        if version != FORMAT_VERSION:
+            return None
+        header = json.loads(handle.read(size))
+        if key is not None and header["key"] != key:
+            return None
+        mapping = mmap.mmap(handle.fileno(), 0, access=mmap.ACCESS_COPY)
+    start = _align(_PREAMBLE.size + size)
+    tables = {}
+    for name, (dtype, shape, offset) in header["arrays"].items():
+        *parents, leaf = name.split("/")
+        node = tables
+        for parent in parents:
+            node = node.setdefault(parent, {})
+        node[leaf] = np.frombuffer(mapping, dtype, math.prod(shape),
+                                   start + offset).reshape(tuple(shape))
+    return tables
+
+
+def compiled_path(path, sample_rate):
+    """Default compiled file of a description: next to it, named after the sample rate."""
+    return f"{os.path.splitext(path)[0]}.{int(round(sample_rate))}.compiled"
+
+
+def load_instrument(path, sample_rate=None, cache_path=None, compile=True):
+    """
+    Load an instrument description, from its compiled form when that is up to date.
+
+    Parameters
+    ----------
+    path : str
+        Description file.
+    sample_rate : float, optional
+        Overrides the description's sample rate.
+    cache_path : str, optional
+        Compiled file; by default ``compiled_path(path, sample_rate)``.
+    compile : bool, optional
+        Write the compiled file when it is missing or stale.
+    """
+    description = read_description(path)
+    rate, _ = _settings(description, sample_rate)
+    cache_path = compiled_path(path, rate) if cache_path is None else cache_path
+    key = description_key(description, rate)
+    tables = read_tables(cache_path, key) if os.path.exists(cache_path) else None
+    if tables is not None:
+        return restore_instrument(description, tables, rate)
+    instrument = build_instrument(description, rate)
+    if compile:
+        write_tables(cache_path, instrument.tables(), key)
+    return instrument
+
+
+def main(argv=None):
+    """Compile descriptions ahead of time (e.g. at install or in a build step)."""
+    parser = argparse.ArgumentParser(description="Compile instrument descriptions.")
+    parser.add_argument("descriptions", nargs="+")
+    parser.add_argument("--sample-rate", type=float, action="append",
+                        help="compile for this rate (repeatable); defaults to the description's")
+    arguments = parser.parse_args(argv)
+    for path in arguments.descriptions:
+        description = read_description(path)
+        for rate in arguments.sample_rate or [None]:
+            start = time.perf_counter()
+            instrument = build_instrument(description, rate)
+            built = time.perf_counter() - start
+            output = compiled_path(path, instrument.sample_rate)
+            write_tables(output, instrument.tables(),
+                         description_key(description, instrument.sample_rate))
+            start = time.perf_counter()
+            restore_instrument(description, read_tables(output), rate)
+            print(f"{output}: {os.path.getsize(output) / 2**20:.1f} MiB, built in {built:.2f} s, "
+                  f"loads in {time.perf_counter() - start:.3f} s")
+
+
+if __name__ == "__main__":
+    main()
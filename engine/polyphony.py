@@ -0,0 +1,239 @@
+"""
+Voice allocation under a CPU budget with energy-aware stealing.
+
+A ``PolyphonyManager`` plays notes on models taken from an ``ObjectPool``. It keeps two
+running averages per voice, updated every block: the energy of the voice's output and
+the time its render took. Together they rank voices by what losing them costs against
+what it saves, energy / cost, with released voices discounted, so a quiet voice with ten
+thousand modes goes long before a loud one with ten.
+
+Voices are removed in three ways:
+
+* Culling: a voice whose smoothed output energy has decayed below the silence threshold
+  is returned to the pool at once (it is inaudible, so no fade is needed). Gating on the
+  running average rather than one block keeps a momentary gap from cutting a voice.
+* Budget: when the measured cost of all sounding voices exceeds the budget (a fraction
+  of the block duration), the lowest-ranked voices are faded out until the rest fit.
+* Stealing: a note-on predicts the new voice's cost (the mean of the voices measured so
+  far) and fades out the lowest-ranked voices until it fits under the budget and the
+  voice limit.
+
+Removed voices are faded out over ``fade_time`` instead of being cut, so a steal is a
+short crossfade to the new note. A fading voice still renders and holds its model until
+the fade ends, so the pool keeps a few models in reserve beyond ``max_voices``; only when
+those are exhausted too is the fading voice with the lowest gain cut. During a fade the
+budget can be overshot by the fading voices' cost for a few blocks.
+"""
+
+import time
+
+import numpy as np
+
+FREE, PLAYING, RELEASED, FADING = 0, 1, 2, 3
+
+# Blocks a new voice plays before it can be culled as silent, so that a note whose
+# excitation builds up over a block or two is not taken for a finished one
+_MIN_BLOCKS = 2
+
+
+class PolyphonyManager:
+    """
+    Polyphonic player that keeps the total render cost under a budget.
+
+    Parameters
+    ----------
+    pool : engine.pools.ObjectPool
+        Voice models. Its capacity bounds the voices rendering at once, fading ones
+        included.
+    start : callable
+        ``start(model, note, velocity)`` loads a note into a model taken from the pool
+        (for example retune and pluck).
+    block_size : int
+        Samples per block.
+    sample_rate : float
+        Sample rate in Hz.
+    cpu_budget : float, optional
+        Fraction of the block duration that rendering every voice may take.
+    max_voices : int, optional
+        Voices playing at once, not counting fading ones. Defaults to the pool capacity
+        less an eighth (at least one) kept for fades.
+    fade_time : float, optional
+        Length in s of the fade-out of stolen and culled voices.
+    silence_threshold : float, optional
+        RMS output level below which a voice counts as finished.
+    release_weight : float, optional
+        Factor applied to the energy of released voices when ranking them.
+    smoothing : float, optional
+        Weight of the newest block in the running averages of energy and cost.
+    render : callable, optional
+        ``render(model)`` returns the model's next block; defaults to processing a block
+        of silence (a freely ringing model).
+    release : callable, optional
+        ``release(model)`` is called on note-off (e.g. to apply a damper).
+    """
+
+    def __init__(self, pool, start, block_size, sample_rate, cpu_budget=0.5, max_voices=None,
+                 fade_time=5e-3, silence_threshold=1e-7, release_weight=0.25, smoothing=0.2,
+                 render=None, release=None):
+        self.pool = pool
+        self.start = start
+        self.block_size = int(block_size)
+        self.budget = cpu_budget * self.block_size / float(sample_rate)
+        capacity = pool.capacity
+        if max_voices is None:
+            max_voices = capacity - max(1, capacity // 8)
+        self.max_voices = int(max_voices)
+        if not 0 < self.max_voices <= capacity:
+            raise ValueError("max_voices must lie between one and the pool capacity")
+        self.fade_step = 1.0 / max(fade_time * sample_rate, 1.0)
+        self.silence_level = silence_threshold**2
+        self.release_weight = release_weight
+        self.smoothing = smoothing
+        silence = np.zeros(self.block_size)
+        self.render = render if render is not None else lambda model: model.process(silence)
+        self.release = release
+
+        # Per pool slot
+        self.status = np.zeros(capacity, dtype=np.int8)
+        self.notes = np.full(capacity, np.nan)
+        self.energy = np.zeros(capacity)
+        self.cost = np.zeros(capacity)
+        self.gain = np.ones(capacity)
+        self.blocks = np.zeros(capacity, dtype=np.int64)
+        self._measured = np.zeros(capacity, dtype=bool)
+        self._output = np.zeros(self.block_size)
+        self._ramp = np.arange(1, self.block_size + 1) / self.block_size
+        self._fade = np.empty(self.block_size)
+        self._clock = time.perf_counter_ns
+        # Voices faded at note-on, faded for the budget, freed as silent, and fades cut short
+        self.stolen = 0
+        self.shed = 0
+        self.culled = 0
+        self.cut = 0
+
+    @property
+    def active_voices(self):
+        """Voices playing or released (not fading)."""
+        return int(np.count_nonzero((self.status == PLAYING) | (self.status == RELEASED)))
+
+    def predicted_cost(self):
+        """Cost in s expected of a new voice: the mean of the voices timed so far."""
+        measured = self.cost[self._measured]
+        return float(measured.mean()) if measured.size else 0.0
+
+    def total_cost(self, include_fading=True):
+        """Sum of the voices' smoothed render times in s."""
+        sounding = self.status != FREE if include_fading else (
+            (self.status == PLAYING) | (self.status == RELEASED))
+        return float(self.cost[sounding].sum())
+
+    def _ranking(self):
+        """Energy lost per second of render time saved, for voices that can be taken."""
+        takeable = (self.status == PLAYING) | (self.status == RELEASED)
+        weight = np.where(self.status == RELEASED, self.release_weight, 1.0)
+        # Untimed voices are still starting; rank them as if they cost the typical voice
+        cost = np.where(self._measured, self.cost, max(self.predicted_cost(), 1e-9))
+        ranking = np.where(takeable, self.energy * weight / np.maximum(cost, 1e-12), np.inf)
+        # Voices started this block have no energy measured yet (it is seeded by their
+        # first block); they go only once no rendered voice is left to take, so a chord
+        # does not steal its own notes
+        ranking[takeable & (self.blocks == 0)] = np.finfo(np.float64).max
+        return ranking
+
+    def _fade_out(self, slot):
+        self.status[slot] = FADING
+
+    def _free(self, slot):
+        self.status[slot] = FREE
+        self.notes[slot] = np.nan
+        self.pool.release(slot)
+
+    def _take_cheapest(self):
+        ranking = self._ranking()
+        slot = int(np.argmin(ranking))
+        if not np.isfinite(ranking[slot]):
+            return False
+        self._fade_out(slot)
+        return True
+
+    def note_on(self, note, velocity=1.0):
+        """
+        Start a note, stealing voices if it would not fit otherwise.
+
+        Returns the pool slot of the new voice.
+        """
+        predicted = self.predicted_cost()
+        while (self.active_voices >= self.max_voices
+               or self.total_cost(include_fading=False) + predicted > self.budget):
+            if not self._take_cheapest():
+                break
+            self.stolen += 1
+        slot = self.pool.acquire()
+        if slot < 0:
+            # Every spare model is still fading: cut the quietest fade short
+            fading = np.flatnonzero(self.status == FADING)
+            victim = int(fading[np.argmin(self.gain[fading])])
+            self._free(victim)
+            self.cut += 1
+            slot = self.pool.acquire()
+        self.start(self.pool[slot], note, velocity)
+        self.status[slot] = PLAYING
+        self.notes[slot] = note
+        self.energy[slot] = 0.0
+        self.cost[slot] = 0.0
+        self.gain[slot] = 1.0
+        self.blocks[slot] = 0
+        self._measured[slot] = False
+        return slot
+
+    def note_off(self, note):
+        """Release every playing voice of ``note``; they ring on but are stolen first."""
+        for slot in np.flatnonzero((self.status == PLAYING) & (self.notes == note)):
+            self.status[slot] = RELEASED
+            if self.release is not None:
+                self.release(self.pool[slot])
+
+    def process(self):
+        """Render and mix one block of every voice, then enforce the budget."""
+        output = self._output
+        output[:] = 0.0
+        alpha = self.smoothing
+        for slot in np.flatnonzero(self.status != FREE):
+            start = self._clock()
+            block = self.render(self.pool[slot])
+            elapsed = (self._clock() - start) * 1e-9
+            level = float(np.dot(block, block)) / block.size
+            if self._measured[slot]:
+                self.cost[slot] += alpha * (elapsed - self.cost[slot])
+                self.energy[slot] += alpha * (level - self.energy[slot])
+            else:
+                # Both averages start from the first block, so a new voice ranks at its
+                # own level rather than ramping up from silence
+                self.cost[slot] = elapsed
+                self.energy[slot] = level
+                self._measured[slot] = True
+            self.blocks[slot] += 1
+
+            if self.status[slot] == FADING:
+                gain = self.gain[slot]
+                end = max(gain - self.fade_step * self.block_size, 0.0)
+                np.multiply(self._ramp, end - gain, out=self._fade)
+                self._fade += gain
+                self._fade *= block
+                output += self._fade
+                self.gain[slot] = end
+                if end == 0.0:
+                    self._free(slot)
+                continue
+            output += block
+            if self.energy[slot] < self.silence_level and self.blocks[slot] >= _MIN_BLOCKS:
+                self._free(slot)
+                self.culled += 1
+
+        # Fading voices are on their way out; shedding more for their cost would empty
+        # the player during every fade
+        while self.total_cost(include_fading=False) > self.budget and self.active_voices > 1:
+            if not self._take_cheapest():
+                break
+            self.shed += 1
+        return output
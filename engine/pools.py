@@ -0,0 +1,202 @@
+"""
+Preallocated voice storage, so that note-on and note-off do not touch the heap.
+
+* ``ObjectPool`` builds a fixed number of model instances up front (oscillator banks, delay
+  lines, grid solvers) and hands them out by index from a free-list stack held in an int
+  array. Note-on takes an instance and loads the note into its existing arrays (for
+  example ``HarmonicOscillatorBank.retune``); note-off resets it and pushes it back.
+* ``StateArena`` is one contiguous block of equally shaped state arrays (the fields of
+  finite difference grids, per-voice buffers) with their views built in advance, so a
+  voice's state is a slot index rather than a fresh array.
+
+Neither is thread-safe: voices are taken and given back by the thread that renders them.
+
+``no_allocation`` is a debug guard for real-time sections. With the environment variable
+``VIRBRAS_ALLOCATION_GUARD`` set, on threads marked with ``mark_realtime``, it raises
+``RealtimeAllocationError`` when the traced heap peak inside the section rose by more than
+a threshold. The peak comes from ``tracemalloc``, which covers NumPy array data as well as
+Python objects, including temporaries freed before the section ends. The peak is
+process-wide, so the guard is meant for tests and debug sessions in which the other
+threads are quiet, and the threshold leaves room for the few hundred bytes of Python
+objects any call creates.
+"""
+
+import os
+import threading
+import tracemalloc
+from functools import partial
+
+import numpy as np
+
+from physics.one_dimensional.harmonic_oscillators import HarmonicOscillatorBank
+from signal_processing.delay_lines import FractionalDelayLine
+
+GUARD_ENABLED = os.environ.get("VIRBRAS_ALLOCATION_GUARD", "") not in ("", "0")
+
+_thread_state = threading.local()
+
+
+class RealtimeAllocationError(RuntimeError):
+    """Heap allocation inside a guarded real-time section."""
+
+
+def mark_realtime(realtime=True):
+    """Mark (or unmark) the calling thread as a real-time thread for ``no_allocation``."""
+    _thread_state.realtime = bool(realtime)
+
+
+class _NoGuard:
+    def __enter__(self):
+        return self
+
+    def __exit__(self, kind, error, traceback):
+        return False
+
+
+_NO_GUARD = _NoGuard()
+
+
+class _Guard:
+    def __init__(self, label, threshold):
+        self.label = label
+        self.threshold = threshold
+
+    def __enter__(self):
+        # Nested sections are covered by the outermost one, whose peak they would reset
+        self.outermost = not getattr(_thread_state, "guarded", False)
+        if self.outermost:
+            _thread_state.guarded = True
+            if not tracemalloc.is_tracing():
+                tracemalloc.start()
+            tracemalloc.reset_peak()
+            self.start = tracemalloc.get_traced_memory()[0]
+        return self
+
+    def __exit__(self, kind, error, traceback):
+        if not self.outermost:
+            return False
+        _thread_state.guarded = False
+        allocated = tracemalloc.get_traced_memory()[1] - self.start
+        if kind is None and allocated > self.threshold:
+            raise RealtimeAllocationError(
+                f"{self.label} allocated up to {allocated} bytes on a real-time thread")
+        return False
+
+
+def no_allocation(label, threshold=4096):
+    """
+    Context manager trapping heap allocation in a real-time section.
+
+    A no-op unless the guard is enabled and the calling thread is marked real-time.
+
+    Parameters
+    ----------
+    label : str
+        Name of the section, used in the error message.
+    threshold : int, optional
+        Bytes the traced heap peak may grow by before the section counts as allocating.
+        The default lets through Python bookkeeping and NumPy's small internal buffers,
+        but not an array of 512 or more float64 samples.
+    """
+    if not (GUARD_ENABLED and getattr(_thread_state, "realtime", False)):
+        return _NO_GUARD
+    return _Guard(label, threshold)
+
+
+class ObjectPool:
+    """
+    Fixed set of preallocated objects handed out by index.
+
+    Parameters
+    ----------
+    factory : callable
+        Called without arguments ``capacity`` times to build the objects.
+    capacity : int
+        Number of objects.
+    reset : str or callable, optional
+        Name of the method that clears an object when it is released, or a function
+        called with the object.
+    """
+
+    def __init__(self, factory, capacity, reset="reset"):
+        self.capacity = int(capacity)
+        if self.capacity < 1:
+            raise ValueError("A pool needs at least one object")
+        self.objects = [factory() for _ in range(self.capacity)]
+        # Bound once, so releasing does not create method objects
+        self._reset = [getattr(item, reset) if isinstance(reset, str) else partial(reset, item)
+                       for item in self.objects]
+        # Free indices form a stack in _free[:_count], lowest index on top
+        self._free = np.arange(self.capacity - 1, -1, -1, dtype=np.intp)
+        self._count = self.capacity
+        self._in_use = np.zeros(self.capacity, dtype=bool)
+
+    def __getitem__(self, index):
+        return self.objects[index]
+
+    @property
+    def available(self):
+        """Number of free objects."""
+        return self._count
+
+    def acquire(self):
+        """Index of a free object, or -1 if every object is in use."""
+        with no_allocation("ObjectPool.acquire"):
+            if self._count == 0:
+                return -1
+            self._count -= 1
+            index = int(self._free[self._count])
+            self._in_use[index] = True
+            return index
+
+    def release(self, index):
+        """Reset an object and return it to the pool."""
+        with no_allocation("ObjectPool.release"):
+            if not self._in_use[index]:
+                raise ValueError(f"Object {index} is not in use")
+            self._reset[index]()
+            self._in_use[index] = False
+            self._free[self._count] = index
+            self._count += 1
+
+
+class StateArena(ObjectPool):
+    """
+    Contiguous storage for ``capacity`` equally shaped state arrays, pooled as slots.
+
+    ``arena[index]`` is the slot's array (a view built once, as slicing at note-on would
+    create a new array object); released slots are cleared to zero.
+
+    Parameters
+    ----------
+    capacity : int
+        Number of slots.
+    shape : tuple of int
+        Shape of one slot (e.g. (fields, nx, ny) for a finite difference grid).
+    dtype : numpy.dtype, optional
+        Element type.
+    """
+
+    def __init__(self, capacity, shape, dtype=np.float64):
+        self.storage = np.zeros((int(capacity),) + tuple(shape), dtype=dtype)
+        slots = iter(self.storage)
+        super().__init__(lambda: next(slots), capacity, reset=lambda slot: slot.fill(0))
+
+
+def oscillator_bank_pool(capacity, max_modes, sample_rate, block_size=64):
+    """
+    Pool of oscillator banks holding up to ``max_modes`` modes each.
+
+    Load a note with ``pool[index].retune(...)`` after ``acquire``; modes beyond the
+    note's own are silent.
+    """
+    frequencies = np.full(int(max_modes), 0.25 * sample_rate)
+    return ObjectPool(lambda: HarmonicOscillatorBank(frequencies, 0.0, sample_rate,
+                                                     input_gains=0.0, output_gains=0.0,
+                                                     block_size=block_size), capacity)
+
+
+def delay_line_pool(capacity, max_delay, max_block_size, interpolator=None):
+    """Pool of ``FractionalDelayLine`` sharing one interpolator; set ``delay`` at note-on."""
+    return ObjectPool(lambda: FractionalDelayLine(max_delay, max_block_size, interpolator),
+                      capacity)
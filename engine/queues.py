@@ -0,0 +1,184 @@
+"""
+Bounded queues for handing note events and parameter changes to the render thread.
+
+Both queues store fixed-size records in a NumPy structured array allocated once, so
+pushing and popping copy record fields into and out of preallocated memory and never
+allocate arrays. The render thread only ever reads and advances counters; it never takes
+a lock, so a control thread that is descheduled mid-push cannot stall it (no priority
+inversion).
+
+* ``SpscQueue``: one producer, one consumer. The producer owns the tail counter and the
+  consumer the head counter; each is only written by its owner, and a record is always
+  written before the counter that publishes it. Push and pop are wait-free.
+* ``MpscQueue``: any number of producers, one consumer. Producers draw tickets from an
+  ``itertools.count`` (an atomic increment in CPython) and every slot carries a sequence
+  number saying whose turn it is, as in Vyukov's bounded queue. The consumer is wait-free;
+  a producer holding a ticket for a slot that is still occupied waits for the consumer.
+
+Counters and sequence numbers live in int64 arrays whose hot entries are a cache line
+(64 bytes) apart, so the producer and consumer sides do not falsely share a line.
+Ordering relies on each NumPy store completing before the next statement, which the
+interpreter lock guarantees.
+"""
+
+import itertools
+import time
+
+import numpy as np
+
+# One cache line of int64 counters
+_LINE = 8
+
+EVENT_DTYPE = np.dtype([
+    ("offset", np.int64),  # sample offset within the block at which the event applies
+    ("kind", np.int32),  # event type (note on, note off, parameter change, ...)
+    ("target", np.int32),  # voice or model the event addresses
+    ("parameter", np.int32),  # parameter index for parameter changes
+    ("value", np.float64),  # new value, velocity, ...
+])
+
+
+def _check_capacity(capacity):
+    capacity = int(capacity)
+    if capacity < 1 or capacity & (capacity - 1):
+        raise ValueError(f"Queue capacity must be a positive power of two, got {capacity}")
+    return capacity
+
+
+class SpscQueue:
+    """
+    Wait-free single-producer, single-consumer ring buffer of records.
+
+    Parameters
+    ----------
+    capacity : int
+        Number of slots (a power of two).
+    dtype : numpy.dtype, optional
+        Record type; defaults to ``EVENT_DTYPE``.
+    """
+
+    def __init__(self, capacity, dtype=EVENT_DTYPE):
+        self.capacity = _check_capacity(capacity)
+        self.mask = self.capacity - 1
+        self.slots = np.zeros(self.capacity, dtype=dtype)
+        # Head (consumer) at [0], tail (producer) at [_LINE]
+        self._counters = np.zeros(2 * _LINE, dtype=np.int64)
+
+    def __len__(self):
+        return int(self._counters[_LINE] - self._counters[0])
+
+    def push(self, record):
+        """Append one record (a tuple of field values); returns False if the queue is full."""
+        tail = int(self._counters[_LINE])
+        if tail - int(self._counters[0]) == self.capacity:
+            return False
+        self.slots[tail & self.mask] = record
+        self._counters[_LINE] = tail + 1
+        return True
+
+    def push_many(self, records):
+        """Append as many of ``records`` (a structured array) as fit; returns the count."""
+        tail = int(self._counters[_LINE])
+        count = min(len(records), self.capacity - (tail - int(self._counters[0])))
+        start = tail & self.mask
+        first = min(count, self.capacity - start)
+        self.slots[start:start + first] = records[:first]
+        self.slots[:count - first] = records[first:count]
+        self._counters[_LINE] = tail + count
+        return count
+
+    def pop_into(self, out, index=0):
+        """Move the oldest record into ``out[index]``; returns False if the queue is empty."""
+        head = int(self._counters[0])
+        if head == int(self._counters[_LINE]):
+            return False
+        out[index] = self.slots[head & self.mask]
+        self._counters[0] = head + 1
+        return True
+
+    def drain(self, out):
+        """Move up to ``len(out)`` records into the structured array ``out``; returns the count."""
+        head = int(self._counters[0])
+        count = min(len(out), int(self._counters[_LINE]) - head)
+        start = head & self.mask
+        first = min(count, self.capacity - start)
+        out[:first] = self.slots[start:start + first]
+        out[first:count] = self.slots[:count - first]
+        self._counters[0] = head + count
+        return count
+
+
+class MpscQueue:
+    """
+    Bounded multi-producer, single-consumer queue of records.
+
+    Parameters
+    ----------
+    capacity : int
+        Number of slots (a power of two).
+    dtype : numpy.dtype, optional
+        Record type; defaults to ``EVENT_DTYPE``.
+    """
+
+    def __init__(self, capacity, dtype=EVENT_DTYPE):
+        self.capacity = _check_capacity(capacity)
+        self.mask = self.capacity - 1
+        self.slots = np.zeros(self.capacity, dtype=dtype)
+        # Slot i is free for ticket t when its sequence is t, and holds ticket t's record
+        # when it is t + 1. Sequences are spread one per cache line.
+        self._sequences = np.zeros(self.capacity * _LINE, dtype=np.int64)
+        self._sequences[::_LINE] = np.arange(self.capacity)
+        self._tickets = itertools.count()
+        # Highest ticket handed out + 1 (producers) and next ticket to read (consumer)
+        self._counters = np.zeros(2 * _LINE, dtype=np.int64)
+
+    def __len__(self):
+        """
+        Records pushed, or being pushed, and not yet popped.
+
+        The producers' counter is updated without a lock, so while they race it can lag
+        behind the tickets handed out; the result is a lower bound then.
+        """
+        return int(self._counters[_LINE] - self._counters[0])
+
+    def push(self, record):
+        """Append one record, waiting for the consumer if its slot is still occupied."""
+        ticket = next(self._tickets)
+        if ticket >= self._counters[_LINE]:
+            self._counters[_LINE] = ticket + 1
+        slot = (ticket & self.mask) * _LINE
+        while self._sequences[slot] != ticket:
+            time.sleep(0)
+        self.slots[ticket & self.mask] = record
+        self._sequences[slot] = ticket + 1
+
+    def try_push(self, record):
+        """
+        Append one record unless the queue is full; returns whether it was appended.
+
+        The fullness check happens before a ticket is drawn, so producers racing for the
+        last free slot may wait briefly in ``push`` instead of failing.
+        """
+        if len(self) >= self.capacity:
+            return False
+        self.push(record)
+        return True
+
+    def pop_into(self, out, index=0):
+        """Move the oldest record into ``out[index]``; returns False if none is ready."""
+        head = int(self._counters[0])
+        slot = (head & self.mask) * _LINE
+        if self._sequences[slot] != head + 1:
+            return False
+        out[index] = self.slots[head & self.mask]
+        # Free the slot for the ticket one lap ahead
+        self._sequences[slot] = head + self.capacity
+        self._counters[0] = head + 1
+        return True
+
+    def drain(self, out):
+        """Move up to ``len(out)`` ready records into ``out`` in ticket order; returns the count."""
+        count = 0
+        while count < len(out) and self.pop_into(out, count):
+            count += 1
+        return count
@@ -0,0 +1,262 @@
+"""
+Offline batch rendering of physics models over note and parameter grids.
+
+A job names a model, its parameters, a note, a velocity and a duration. ``render_batch``
+spreads the jobs over worker processes (or threads), and every worker keeps the model
+instance of its last job, keyed by (model, parameters, note): the expensive setup, such
+as tuning an oscillator bank or building a plate's coupling tensor, is done once per run
+of equal keys, and later jobs in the run only reset the instance. Jobs are sorted by key
+and handed out in chunks, so consecutive jobs on a worker mostly share it, and a worker
+holds one instance however many distinct keys the batch has.
+
+Workers write each result straight to ``<output_dir>/<index>.npy`` (via a temporary file
+and a rename, so a file is either complete or absent) and return only a summary, which
+keeps audio out of the inter-process traffic. A manifest ordered by job index is
+written once the batch is done; a resumed batch (``skip_existing``) carries over the
+summaries of files rendered earlier, reading them back from the files when an
+interrupted run never wrote its manifest.
+
+Results do not depend on the number of workers: every job starts from a freshly reset
+instance and draws any randomness from a generator seeded by the batch seed and the
+job's index, never from state left by the jobs a worker happened to run before it.
+Chunks render with subnormals flushed to zero (``signal_processing.denormals``) on every
+worker alike, so the mode cannot make results depend on where a job ran.
+"""
+
+import json
+import os
+import threading
+from concurrent.futures import ProcessPoolExecutor, ThreadPoolExecutor
+from dataclasses import dataclass, field
+
+import numpy as np
+
+from physics.one_dimensional.strings import ModalString, note_frequency
+from physics.two_dimensional.plates import VonKarmanPlate
+from signal_processing.denormals import flush_to_zero
+
+
+@dataclass(frozen=True)
+class RenderJob:
+    """
+    One render.
+
+    Attributes
+    ----------
+    model : str
+        Name of a registered renderer.
+    note : float
+        MIDI note number.
+    duration : float
+        Length of the render in s.
+    velocity : float
+        Excitation strength from 0 to 1.
+    parameters : tuple of (str, value)
+        Model parameters as sorted key/value pairs (see ``make_job``).
+    """
+
+    model: str
+    note: float
+    duration: float
+    velocity: float = 1.0
+    parameters: tuple = field(default=())
+
+    @property
+    def options(self):
+        return dict(self.parameters)
+
+    @property
+    def key(self):
+        """Jobs with equal keys can share one model instance."""
+        return (self.model, self.parameters, self.note)
+
+
+def make_job(model, note, duration, velocity=1.0, **parameters):
+    """Build a ``RenderJob`` with keyword model parameters."""
+    return RenderJob(model, float(note), float(duration), float(velocity),
+                     tuple(sorted(parameters.items())))
+
+
+def _build_string(job, sample_rate):
+    options = job.options
+    length = options.get("length", 0.65)
+    linear_density = options.get("linear_density", 6e-3)
+    # Tension that puts the fundamental on the note
+    tension = (2.0 * length * note_frequency(job.note))**2 * linear_density
+    return ModalString(length, tension, linear_density, sample_rate,
+                       num_modes=options.get("num_modes", 64),
+                       inharmonicity=options.get("inharmonicity", 0.0),
+                       pickup_position=options.get("pickup_position", 0.9))
+
+
+def _render_string(string, job, sample_rate, rng):
+    string.reset()
+    string.pluck(job.options.get("pluck_position", 0.2), 1e-3 * job.velocity)
+    return string.process(np.zeros(int(round(job.duration * sample_rate))))
+
+
+def _build_plate(job, sample_rate):
+    options = job.options
+    return VonKarmanPlate(options.get("width", 0.4), options.get("height", 0.3),
+                          options.get("thickness", 1e-3), options.get("density", 7860.0),
+                          options.get("youngs_modulus", 2e11), options.get("poisson_ratio", 0.3),
+                          options.get("num_modes", 100), sample_rate)
+
+
+def _render_plate(plate, job, sample_rate, rng):
+    plate.reset()
+    samples = int(round(job.duration * sample_rate))
+    # Mallet strike: a raised-cosine force pulse whose length shrinks with velocity
+    width = max(int(sample_rate * 2e-3 * (1.5 - job.velocity)), 2)
+    excitation = np.zeros(samples)
+    pulse = job.options.get("force", 100.0) * job.velocity * np.hanning(width)
+    excitation[:min(width, samples)] = pulse[:samples]
+    return plate.process(excitation)
+
+
+# name -> (build(job, sample_rate), render(instance, job, sample_rate, rng))
+RENDERERS = {
+    "string": (_build_string, _render_string),
+    "plate": (_build_plate, _render_plate),
+}
+
+
+def register_renderer(name, build, render):
+    """
+    Make a model available to ``render_batch``.
+
+    ``build(job, sample_rate)`` creates an instance from the job's model parameters and
+    note; ``render(instance, job, sample_rate, rng)`` resets it, renders the job and
+    returns the samples. Worker processes see renderers registered before the batch
+    starts when they are forked (the default on Linux); with the spawn start method,
+    register them at import time of a module the workers import.
+    """
+    RENDERERS[name] = (build, render)
+
+
+_local = threading.local()
+
+
+def _instance(job, sample_rate):
+    # Jobs reach a worker sorted by key, so only the last instance is worth keeping
+    key = job.key + (sample_rate,)
+    if getattr(_local, "key", None) != key:
+        _local.instance = RENDERERS[job.model][0](job, sample_rate)
+        _local.key = key
+    return _local.instance
+
+
+def _render_chunk(chunk, sample_rate, output_dir, seed, dtype):
+    with flush_to_zero():
+        return _render_jobs(chunk, sample_rate, output_dir, seed, dtype)
+
+
+def _render_jobs(chunk, sample_rate, output_dir, seed, dtype):
+    summaries = []
+    for index, job in chunk:
+        rng = np.random.default_rng(np.random.SeedSequence([seed, index]))
+        instance = _instance(job, sample_rate)
+        samples = np.asarray(RENDERERS[job.model][1](instance, job, sample_rate, rng),
+                             dtype=dtype)
+        path = os.path.join(output_dir, f"{index:06d}.npy")
+        temporary = path + ".tmp"
+        with open(temporary, "wb") as handle:
+            np.save(handle, samples)
+        os.replace(temporary, path)
+        summaries.append(_summary(index, path, samples))
+    return summaries
+
+
+def _summary(index, path, samples):
+    return {"index": index, "file": os.path.basename(path), "samples": int(samples.size),
+            "peak": float(np.max(np.abs(samples))) if samples.size else 0.0}
+
+
+def render_batch(jobs, output_dir, sample_rate=48000.0, num_workers=None, use_threads=False,
+                 chunk_size=16, seed=0, dtype=np.float32, skip_existing=False, progress=None):
+    """
+    Render a list of jobs to disk.
+
+    Parameters
+    ----------
+    jobs : sequence of RenderJob
+        Jobs; their position in the sequence is their index and output file name.
+    output_dir : str
+        Directory for ``<index>.npy`` files and ``manifest.json`` (created if needed).
+    sample_rate : float, optional
+        Sample rate in Hz.
+    num_workers : int, optional
+        Worker processes (or threads); defaults to the number of CPUs. Zero renders on the
+        calling thread.
+    use_threads : bool, optional
+        Use threads instead of processes, for renderers that spend their time in NumPy
+        kernels that release the interpreter lock.
+    chunk_size : int, optional
+        Jobs handed to a worker at a time.
+    seed : int, optional
+        Batch seed for the renderers' random generators.
+    dtype : numpy.dtype, optional
+        Sample type of the output files.
+    skip_existing : bool, optional
+        Do not re-render jobs whose output file already exists (to resume a batch).
+    progress : callable, optional
+        Called with each chunk's list of summaries as it completes.
+
+    Returns
+    -------
+    list of dict
+        Per-job summaries (index, file, samples, peak) in job order; also written to
+        ``manifest.json`` together with the jobs.
+    """
+    os.makedirs(output_dir, exist_ok=True)
+    indexed, skipped = [], []
+    for index, job in enumerate(jobs):
+        if skip_existing and os.path.exists(os.path.join(output_dir, f"{index:06d}.npy")):
+            skipped.append(index)
+        else:
+            indexed.append((index, job))
+    indexed.sort(key=lambda item: (repr(item[1].key), item[0]))
+    chunks = [indexed[i:i + chunk_size] for i in range(0, len(indexed), chunk_size)]
+    arguments = (sample_rate, output_dir, seed, dtype)
+
+    summaries = []
+    if num_workers == 0:
+        results = (_render_chunk(chunk, *arguments) for chunk in chunks)
+        executor = None
+    else:
+        pool = ThreadPoolExecutor if use_threads else ProcessPoolExecutor
+        executor = pool(num_workers)
+        futures = [executor.submit(_render_chunk, chunk, *arguments) for chunk in chunks]
+        results = (future.result() for future in futures)
+    try:
+        for chunk_summaries in results:
+            summaries.extend(chunk_summaries)
+            if progress is not None:
+                progress(chunk_summaries)
+    finally:
+        if executor is not None:
+            executor.shutdown(wait=True, cancel_futures=True)
+
+    manifest_path = os.path.join(output_dir, "manifest.json")
+    if skipped:
+        # Keep the summaries of the files rendered by earlier runs; a run that stopped
+        # before writing its manifest left files without one, so summarize those again
+        previous = {}
+        if os.path.exists(manifest_path):
+            with open(manifest_path) as handle:
+                previous = {entry["index"]: entry for entry in json.load(handle)["rendered"]}
+        for index in skipped:
+            if index not in previous:
+                path = os.path.join(output_dir, f"{index:06d}.npy")
+                previous[index] = _summary(index, path, np.load(path, mmap_mode="r"))
+        previous.update((summary["index"], summary) for summary in summaries)
+        summaries = [entry for index, entry in previous.items() if index < len(jobs)]
+    summaries.sort(key=lambda summary: summary["index"])
+    manifest = {"sample_rate": sample_rate, "seed": seed, "dtype": np.dtype(dtype).name,
+                "jobs": [{"model": job.model, "note": job.note, "duration": job.duration,
+                          "velocity": job.velocity, "parameters": job.options}
+                         for job in jobs],
+                "rendered": summaries}
+    with open(manifest_path, "w") as handle:
+        json.dump(manifest, handle, indent=1)
+    return summaries
@@ -0,0 +1,216 @@
+"""
+Opt-in per-block timing of voices, models and graph nodes.
+
+Render times are recorded in nanoseconds into log-linear histograms in the style of
+HdrHistogram: values below 2^B are counted exactly, and every power of two above that is
+split into 2^(B - 1) equal buckets, so the relative resolution is 2^(1 - B) (about 3% at
+the default B = 6) over the whole range while the histogram stays a few hundred counters.
+Recording is a bit-length, two shifts and an increment of a preallocated int64 array.
+
+Each histogram has a single writer: the thread rendering the thing it measures. Readers
+never modify it, so no lock is taken on the render thread; a reader copies the counters
+and derives every statistic from that copy, so a snapshot taken mid-record can at most
+miss the block being recorded. Every histogram also counts blocks that took longer than
+its budget (by default the duration of one block), which is what turns into a dropout.
+
+Instrumentation is opt-in: ``Instrumentation.wrap`` returns a timed wrapper around a
+processing callable, and ``ProcessingGraph`` wraps its nodes when given an instance.
+"""
+
+import threading
+import time
+from dataclasses import dataclass
+
+import numpy as np
+
+
+class TimingHistogram:
+    """
+    Log-linear histogram of durations in nanoseconds with a single writer.
+
+    Parameters
+    ----------
+    budget : float
+        Duration in s above which a recorded block counts as an overrun.
+    max_duration : float, optional
+        Longest duration resolved, in s; longer ones go to the last bucket (the maximum
+        is still kept exactly).
+    precision_bits : int, optional
+        B: every power of two is split into 2^(B - 1) buckets.
+    """
+
+    def __init__(self, budget, max_duration=10.0, precision_bits=6):
+        self.precision_bits = int(precision_bits)
+        if self.precision_bits < 1:
+            raise ValueError("precision_bits must be at least one")
+        self.budget = int(budget * 1e9)
+        self._half = 1 << (self.precision_bits - 1)
+        self.num_buckets = self._index(int(max_duration * 1e9)) + 1
+        self.counts = np.zeros(self.num_buckets, dtype=np.int64)
+        # total time, maximum, overruns
+        self.totals = np.zeros(3, dtype=np.int64)
+
+    def _index(self, value):
+        magnitude = value.bit_length() - self.precision_bits
+        if magnitude <= 0:
+            return value
+        return magnitude * self._half + (value >> magnitude)
+
+    def bucket_bounds(self):
+        """Lower and upper (exclusive) bound in ns of every bucket."""
+        index = np.arange(self.num_buckets)
+        magnitude = np.maximum(index // self._half - 1, 0)
+        lower = np.where(index < 2 * self._half, index,
+                         (index - magnitude * self._half) << magnitude)
+        return lower, lower + (1 << magnitude)
+
+    def record(self, duration):
+        """Add one duration in ns (an int, as from ``time.perf_counter_ns``)."""
+        index = self._index(duration)
+        self.counts[index if index < self.num_buckets else -1] += 1
+        totals = self.totals
+        totals[0] += duration
+        if duration > totals[1]:
+            totals[1] = duration
+        if duration > self.budget:
+            totals[2] += 1
+
+    def snapshot(self):
+        """Copy of the current state; safe to call from any thread."""
+        counts = self.counts.copy()
+        total, maximum, overruns = self.totals.tolist()
+        return HistogramSnapshot(counts, *self.bucket_bounds(), total, maximum, overruns,
+                                 self.budget)
+
+
+@dataclass
+class HistogramSnapshot:
+    """
+    Timing statistics of one histogram at one moment.
+
+    Durations are in ns. ``count`` is taken from the copied buckets; ``total`` and
+    ``maximum`` are read right after them, so they may already include a block that the
+    buckets do not.
+    """
+
+    counts: np.ndarray
+    lower: np.ndarray
+    upper: np.ndarray
+    total: int
+    maximum: int
+    overruns: int
+    budget: int
+
+    @property
+    def count(self):
+        return int(self.counts.sum())
+
+    @property
+    def mean(self):
+        return self.total / self.count if self.count else 0.0
+
+    def percentile(self, q):
+        """Upper bound of the bucket holding the q-th percentile (0 to 100), in ns."""
+        count = self.count
+        if count == 0:
+            return 0.0
+        position = np.searchsorted(np.cumsum(self.counts), max(q / 100.0 * count, 1.0))
+        return float(min(self.upper[position] - 1, self.maximum))
+
+    def since(self, earlier):
+        """
+        Statistics of the blocks recorded between ``earlier`` and this snapshot.
+
+        The maximum is not kept per interval, so it stays the maximum since the start.
+        """
+        return HistogramSnapshot(self.counts - earlier.counts, self.lower, self.upper,
+                                 self.total - earlier.total, self.maximum,
+                                 self.overruns - earlier.overruns, self.budget)
+
+    def summary(self, percentiles=(50.0, 90.0, 99.0, 99.9)):
+        """Plain dictionary of the main statistics in microseconds."""
+        result = {"count": self.count, "overruns": self.overruns, "budget_us": self.budget / 1e3,
+                  "mean_us": self.mean / 1e3, "max_us": self.maximum / 1e3}
+        for q in percentiles:
+            result[f"p{q:g}_us"] = self.percentile(q) / 1e3
+        return result
+
+
+class Instrumentation:
+    """
+    Named timing histograms sharing a block budget.
+
+    Names are free-form; the convention is ``voice/<index>``, ``model/<name>`` and
+    ``node/<name>``. Histograms are created by the first ``histogram`` or ``wrap`` call for
+    a name, which allocates, so set them up before rendering starts.
+
+    Parameters
+    ----------
+    block_size : int
+        Samples per block.
+    sample_rate : float
+        Sample rate in Hz.
+    budget_fraction : float, optional
+        Fraction of the block duration a single histogram may take before a block counts
+        as an overrun.
+    **options
+        Passed to every ``TimingHistogram``.
+    """
+
+    def __init__(self, block_size, sample_rate, budget_fraction=1.0, **options):
+        self.block_duration = int(block_size) / float(sample_rate)
+        self.budget = budget_fraction * self.block_duration
+        self._options = options
+        self._histograms = {}
+        self._lock = threading.Lock()
+
+    def histogram(self, name, budget=None):
+        """Histogram for ``name``, created with ``budget`` (in s) if it does not exist."""
+        with self._lock:
+            histogram = self._histograms.get(name)
+            if histogram is None:
+                histogram = self._histograms[name] = TimingHistogram(
+                    self.budget if budget is None else budget, **self._options)
+            return histogram
+
+    def wrap(self, name, function, budget=None):
+        """
+        Callable that times every call of ``function`` into the histogram ``name``.
+
+        Calls must not overlap in time (one writer per histogram).
+        """
+        histogram = self.histogram(name, budget)
+        clock = time.perf_counter_ns
+
+        def timed(*arguments, **keywords):
+            start = clock()
+            try:
+                return function(*arguments, **keywords)
+            finally:
+                histogram.record(clock() - start)
+        timed.__wrapped__ = function
+        return timed
+
+    def instrument(self, name, model, method="process", budget=None):
+        """Time ``model.<method>`` in place (e.g. a voice's or model's block call)."""
+        setattr(model, method, self.wrap(name, getattr(model, method), budget))
+        return model
+
+    def snapshot(self):
+        """Snapshots of every histogram by name; safe to poll from a non-real-time thread."""
+        with self._lock:
+            histograms = list(self._histograms.items())
+        return {name: histogram.snapshot() for name, histogram in histograms}
+
+    def report(self, previous=None):
+        """
+        Summaries of every histogram, worst overrun count first.
+
+        With ``previous`` (an earlier ``snapshot()``), only the blocks since then count.
+        """
+        current = self.snapshot()
+        if previous is not None:
+            current = {name: snapshot.since(previous[name]) if name in previous else snapshot
+                       for name, snapshot in current.items()}
+        summaries = {name: snapshot.summary() for name, snapshot in current.items()}
+        return dict(sorted(summaries.items(), key=lambda item: -item[1]["overruns"]))
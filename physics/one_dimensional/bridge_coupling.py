@@ -0,0 +1,246 @@
+"""
+Coupling of several modal strings to a shared modal body through a bridge.
+
+Each string is attached at its bridge point to a point on the body, and the two are
+held together by a constraint force lambda_i. Because every modal displacement after an
+oscillator-bank step is affine in the applied force, enforcing
+
+    w_i(bridge) = y(b_i)    for every string i
+
+at the new time step reduces to the dense S x S system
+
+    (diag(a) + B) lambda = -(w_free - y_free)
+
+where a_i is the bridge admittance of string i, B is the body's point-to-point admittance
+between the bridge points and the free displacements are those the banks would reach
+unforced. The matrix only depends on the mode tables, so it is inverted once when the
+string set changes (at note-on) and each sample costs a small matrix-vector product.
+"""
+
+import numpy as np
+
+from physics.one_dimensional.harmonic_oscillators import HarmonicOscillatorBank
+
+
+class BridgeCoupling:
+    """
+    Strings and a modal body advanced together with a rigid bridge constraint.
+
+    All string modes are stacked into a single ``HarmonicOscillatorBank`` so one sample of
+    every string costs a few vector operations regardless of the number of strings. Each
+    string owns a fixed run of rows, so ``set_string`` retunes those rows in place; rows a
+    shorter string leaves unused are silent.
+
+    Parameters
+    ----------
+    strings : list of ModalString
+        String models; only their mode tables and shapes are used.
+    body : HarmonicOscillatorBank
+        Modal body. Its output gains define the body output (e.g. a radiation weighting).
+    bridge_shapes : array_like
+        Body mode shapes at the attachment point of each string, shape
+        (num_strings, body.num_modes), mapping modal to physical displacement.
+    force_shapes : array_like, optional
+        Modal force per unit of point force at each attachment point, same shape.
+        Defaults to ``bridge_shapes``, which is right for mass-normalized modes; bodies
+        normalized otherwise divide by their modal masses (a plate's area-normalized
+        shapes by its mass per area).
+    """
+
+    def __init__(self, strings, body, bridge_shapes, force_shapes=None):
+        self.body = body
+        self.bridge_shapes = np.atleast_2d(np.asarray(bridge_shapes, dtype=np.float64))
+        if self.bridge_shapes.shape != (len(strings), body.num_modes):
+            raise ValueError("bridge_shapes must have shape (num_strings, num_body_modes)")
+        self.force_shapes = self.bridge_shapes if force_shapes is None else np.broadcast_to(
+            np.asarray(force_shapes, dtype=np.float64), self.bridge_shapes.shape)
+        self.strings = list(strings)
+        if any(string.sample_rate != body.sample_rate for string in self.strings):
+            raise ValueError("Strings must run at the sample rate of the body")
+        if len({string.oscillators.block_size for string in self.strings}) > 1:
+            raise ValueError("Strings must share one block size")
+        self._assemble([string.num_modes for string in self.strings])
+
+    @classmethod
+    def from_tables(cls, tables, strings, body):
+        """
+        Rebuild a coupling from ``tables`` and the (already rebuilt) strings and body,
+        without reassembling the string modes or refactoring the constraint.
+        """
+        coupling = cls.__new__(cls)
+        coupling.body = body
+        coupling.strings = list(strings)
+        coupling.bridge_shapes = tables["bridge_shapes"]
+        coupling.force_shapes = tables["force_shapes"]
+        coupling.owner = tables["owner"]
+        coupling.mode_index = tables["mode_index"]
+        coupling.string_bridge_shapes = tables["string_bridge_shapes"]
+        coupling.string_modes = HarmonicOscillatorBank.from_tables(tables["string_modes"])
+        coupling._constraint_inverse = tables["constraint_inverse"]
+        return coupling
+
+    def tables(self):
+        """Stacked string modes and the factored constraint as a nested dictionary of arrays."""
+        return {"bridge_shapes": self.bridge_shapes, "force_shapes": self.force_shapes,
+                "owner": self.owner,
+                "mode_index": self.mode_index,
+                "string_bridge_shapes": self.string_bridge_shapes,
+                "string_modes": self.string_modes.tables(),
+                "constraint_inverse": self._constraint_inverse}
+
+    @property
+    def num_strings(self):
+        return len(self.strings)
+
+    def _assemble(self, capacities):
+        """
+        Allocate the stacked bank with ``capacities[i]`` rows for string ``i`` and load
+        every string into its rows.
+        """
+        rate = self.body.sample_rate
+        self.owner = np.repeat(np.arange(self.num_strings), capacities)
+        # Mode of the owning string held by each row; -1 marks a silent spare row
+        self.mode_index = np.full(self.owner.size, -1)
+        self.string_modes = HarmonicOscillatorBank(
+            np.full(self.owner.size, 0.25 * rate), 0.0, rate, input_gains=0.0,
+            output_gains=0.0, block_size=self.strings[0].oscillators.block_size)
+        self.string_bridge_shapes = np.zeros(self.owner.size)
+        for index, string in enumerate(self.strings):
+            self._load(index, string)
+        self.prepare()
+
+    def _kept_modes(self, string):
+        # Like the strings themselves, drop the modes at or above the current Nyquist
+        nyquist = 0.5 * self.string_modes.sample_rate
+        return np.flatnonzero(string.oscillators.frequencies < nyquist)
+
+    def _load(self, index, string):
+        """Write ``string``'s modes into the rows of string ``index``, silencing the spares."""
+        rows = np.flatnonzero(self.owner == index)
+        kept = self._kept_modes(string)
+        count = kept.size
+        bank = string.oscillators
+        frequencies = np.full(rows.size, 0.25 * self.string_modes.sample_rate)
+        frequencies[:count] = bank.frequencies[kept]
+        decay_rates, input_gains, output_gains = np.zeros((3, rows.size))
+        decay_rates[:count] = bank.decay_rates[kept]
+        input_gains[:count] = bank.input_gains[kept]
+        output_gains[:count] = bank.output_gains[kept]
+        self.string_modes.update_modes(rows, frequencies, decay_rates, input_gains, output_gains)
+        self.string_modes.state[rows] = 0.0
+        self.string_bridge_shapes[rows] = 0.0
+        self.string_bridge_shapes[rows[:count]] = string.bridge_shapes[kept]
+        self.mode_index[rows] = -1
+        self.mode_index[rows[:count]] = kept
+
+    def prepare(self):
+        """Factor the constraint system. Called whenever the string set changes."""
+        string_admittance = np.bincount(
+            self.owner, weights=self.string_bridge_shapes**2 * self.string_modes.force_sensitivity,
+            minlength=self.num_strings)
+        body_admittance = (self.bridge_shapes * self.body.force_sensitivity) @ self.force_shapes.T
+        self._constraint_inverse = np.linalg.inv(np.diag(string_admittance) + body_admittance)
+
+    def set_sample_rate(self, sample_rate):
+        """
+        Switch the stacked string modes and the body to another sample rate.
+
+        Both banks keep their coefficients per rate; the admittances change with the rate,
+        so the constraint is refactored.
+        """
+        self.string_modes.set_sample_rate(sample_rate)
+        self.body.set_sample_rate(sample_rate)
+        self.prepare()
+
+    def set_string(self, index, string):
+        """
+        Replace one string (e.g. at note-on with a new tuning) and refactor the coupling.
+
+        The new string has to be built at the rate of the one it replaces; modes at or
+        above the Nyquist frequency of the current rate are dropped. Its modes are loaded
+        into the rows of the old string in place, so the bank is only reallocated when
+        the new string keeps more modes than any string held in that slot before. The
+        states of the other strings and of the body are preserved.
+        """
+        if string.sample_rate != self.strings[index].sample_rate:
+            raise ValueError("A replacement string must have the rate of the string it replaces")
+        capacities = np.bincount(self.owner, minlength=self.num_strings)
+        needed = self._kept_modes(string).size
+        self.strings[index] = string
+        if needed <= capacities[index]:
+            self._load(index, string)
+            self.prepare()
+            return
+        states = [self.string_modes.state[self.owner == i] for i in range(self.num_strings)]
+        capacities[index] = needed
+        self._assemble(capacities)
+        for i, state in enumerate(states):
+            if i != index:
+                self.string_modes.state[self.owner == i] = state
+
+    def pluck(self, index, position, amplitude):
+        """Release string ``index`` from a triangular shape."""
+        rows = np.flatnonzero(self.owner == index)
+        modes = self.mode_index[rows]
+        displacement = self.strings[index].pluck_displacement(position, amplitude)
+        self.string_modes.state[rows] = 1j * np.where(modes >= 0, displacement[modes], 0.0)
+
+    def reset(self):
+        """Bring the strings and the body to rest."""
+        self.string_modes.reset()
+        self.body.reset()
+
+    def step(self, excitations=None):
+        """
+        Advance strings and body by one sample.
+
+        Parameters
+        ----------
+        excitations : array_like, optional
+            Force applied to each string at its excitation position, shape (num_strings,).
+
+        Returns
+        -------
+        tuple of float and numpy.ndarray
+            Body output and pickup displacement of every string.
+        """
+        strings, body = self.string_modes, self.body
+        drive = np.zeros(strings.num_modes)
+        if excitations is not None:
+            drive = strings.input_gains * np.asarray(excitations, dtype=np.float64)[self.owner]
+        string_free = strings.free_displacement() + strings.force_sensitivity * drive
+        bridge_free = np.bincount(self.owner, weights=self.string_bridge_shapes * string_free,
+                                  minlength=self.num_strings)
+        body_free = self.bridge_shapes @ body.free_displacement()
+        constraint = -self._constraint_inverse @ (bridge_free - body_free)
+
+        strings.step(modal_force=drive + self.string_bridge_shapes * constraint[self.owner])
+        body_output = body.step(modal_force=-(constraint @ self.force_shapes))
+        string_outputs = np.bincount(self.owner,
+                                     weights=strings.output_gains * strings.displacement,
+                                     minlength=self.num_strings)
+        return body_output, string_outputs
+
+    def process(self, num_samples, excitations=None):
+        """
+        Run the coupled system.
+
+        Parameters
+        ----------
+        num_samples : int
+            Number of samples to render.
+        excitations : array_like, optional
+            String forces of shape (num_strings, num_samples).
+
+        Returns
+        -------
+        tuple of numpy.ndarray
+            Body output of shape (num_samples,) and string pickup signals of shape
+            (num_strings, num_samples).
+        """
+        body_output = np.empty(num_samples)
+        string_outputs = np.empty((self.num_strings, num_samples))
+        for n in range(num_samples):
+            forces = None if excitations is None else excitations[:, n]
+            body_output[n], string_outputs[:, n] = self.step(forces)
+        return body_output, string_outputs
@@ -0,0 +1,411 @@
+"""
+Banks of independent damped harmonic oscillators.
+
+Each oscillator obeys
+
+    q'' + 2 sigma q' + omega^2 q = f(t)
+
+and is discretized by impulse invariance, so the discrete impulse response is the
+sampled continuous one for every frequency below Nyquist, with no stability limit on
+the time step. Internally every mode is held as a complex one-pole state z whose
+imaginary part is the displacement, which lets whole blocks of samples be computed
+with a handful of matrix products instead of a per-sample loop.
+
+All coefficient arrays are allocated by the constructor and filled in place, so a bank
+taken from a pool can be loaded with a new note's modes by ``retune`` without touching
+the heap. ``tables`` and ``from_tables`` hand the mode table and everything derived from
+it to a bank built elsewhere (e.g. from a memory-mapped instrument cache) as arrays.
+
+The discrete-time coefficients depend on the sample rate, and a bank keeps one set per
+rate it has run at: ``set_sample_rate`` switches between them (``prepare_sample_rates``
+fills the common host rates ahead of time), and ``update_modes`` changes a few modes by
+recomputing only their rows, deferring the other rates' rows to the next switch. States
+that have decayed into the subnormal range are flushed to zero once per block, and so
+are vanishing entries of the coefficient tables of heavily damped modes.
+"""
+
+import numpy as np
+
+from signal_processing.denormals import flush_denormals
+
+# Host rates that ``prepare_sample_rates`` covers by default, in Hz
+COMMON_SAMPLE_RATES = (44100.0, 48000.0, 88200.0, 96000.0, 192000.0)
+
+
+class HarmonicOscillatorBank:
+    """
+    A bank of damped harmonic oscillators driven by a common excitation.
+
+    Parameters
+    ----------
+    frequencies : array_like
+        Undamped natural frequencies in Hz, one per mode.
+    decay_rates : array_like
+        Exponential amplitude decay rates sigma in 1/s, one per mode.
+    sample_rate : float
+        Sample rate in Hz.
+    input_gains : array_like, optional
+        Per-mode weight applied to the scalar excitation (e.g. mode shape at the
+        excitation point). Defaults to one.
+    output_gains : array_like, optional
+        Per-mode weight applied when summing displacements into the output (e.g. mode
+        shape at the pickup point). Defaults to one.
+    block_size : int, optional
+        Length of the blocks used by ``process``. The block matrices scale with
+        ``num_modes * block_size``.
+    """
+
+    def __init__(self, frequencies, decay_rates, sample_rate, input_gains=None, output_gains=None,
+                 block_size=64):
+        self.frequencies = np.atleast_1d(np.asarray(frequencies, dtype=np.float64))
+        self.decay_rates = np.broadcast_to(
+            np.asarray(decay_rates, dtype=np.float64), self.frequencies.shape).copy()
+        self.sample_rate = float(sample_rate)
+        self.num_modes = self.frequencies.size
+        self.input_gains = self._per_mode(input_gains)
+        self.output_gains = self._per_mode(output_gains)
+        self.block_size = int(block_size)
+        if np.any(self.frequencies <= 0.0):
+            raise ValueError("Oscillator frequencies must be positive")
+        if np.any(self.frequencies >= 0.5 * self.sample_rate):
+            raise ValueError("Oscillator frequencies must lie below the Nyquist frequency")
+        if self.block_size < 1:
+            raise ValueError("Block size must be at least one sample")
+        self.state = np.zeros(self.num_modes, dtype=np.complex128)
+        # Samples advanced by ``step`` since the state was last flushed
+        self._unflushed = 0
+        self._allocate()
+        self._rate_tables = {}
+        self._add_rate_tables()
+        self._compute_coefficients()
+
+    # Arrays that define a tuned bank; the scratch buffers are rebuilt by ``_allocate``
+    _TABLES = ("frequencies", "decay_rates", "input_gains", "output_gains", "poles",
+               "force_scale", "_powers_imag", "_state_to_output", "_input_to_output",
+               "_input_to_state", "_block_pole")
+    # The subset that depends on the sample rate, held once per rate
+    _RATE_TABLES = ("poles", "force_scale", "_powers_imag", "_state_to_output",
+                    "_input_to_state", "_block_pole", "_input_to_output")
+
+    @classmethod
+    def from_tables(cls, tables):
+        """
+        Build a bank around the arrays returned by ``tables`` without recomputing them.
+
+        The arrays are adopted, not copied, so they can be memory-mapped; they have to be
+        writable (a copy-on-write map will do) for ``retune`` to work.
+        """
+        bank = cls.__new__(cls)
+        bank.sample_rate = float(tables["sample_rate"])
+        bank.num_modes = tables["frequencies"].size
+        bank.block_size = tables["state_to_output"].shape[1]
+        bank.state = np.zeros(bank.num_modes, dtype=np.complex128)
+        bank._unflushed = 0
+        bank._allocate()
+        rate_tables = {}
+        for name in cls._TABLES:
+            array = tables[name.lstrip("_")]
+            setattr(bank, name, array)
+            if name in cls._RATE_TABLES:
+                rate_tables[name] = array
+        bank._rate_tables = {bank.sample_rate: (rate_tables,
+                                                np.zeros(bank.num_modes, dtype=bool))}
+        return bank
+
+    def tables(self):
+        """Mode table and derived coefficients by name, for ``from_tables``."""
+        tables = {name.lstrip("_"): getattr(self, name) for name in self._TABLES}
+        tables["sample_rate"] = np.array(self.sample_rate)
+        return tables
+
+    def _per_mode(self, gains):
+        if gains is None:
+            return np.ones(self.num_modes)
+        return np.broadcast_to(np.asarray(gains, dtype=np.float64), (self.num_modes,)).copy()
+
+    def _allocate(self):
+        modes, size = self.num_modes, self.block_size
+        # Continuous poles (i omega_d - sigma) dt, and the sample indices they are raised to
+        self._rates = np.empty(modes, dtype=np.complex128)
+        self._exponents = np.arange(1, size + 1, dtype=np.complex128)
+        self._work = np.empty((3, modes))
+        self._complex_work = np.empty(modes, dtype=np.complex128)
+        self._powers = np.empty((modes, size), dtype=np.complex128)
+        # The impulse response has a trailing zero that fills the upper triangle of the
+        # Toeplitz matrix through the lag table
+        self._impulse = np.zeros(size + 1)
+        lags = np.arange(size)[:, None] - np.arange(size)[None, :]
+        self._lags = np.where(lags >= 0, lags, size)
+
+    def _add_rate_tables(self):
+        """
+        Allocate a coefficient set for the current sample rate and switch to it. Every
+        rate used keeps its set in ``_rate_tables``, with a mask of the modes changed
+        since the set was computed.
+        """
+        modes, size = self.num_modes, self.block_size
+        tables = {"poles": np.empty(modes, dtype=np.complex128),
+                  "force_scale": np.empty(modes),
+                  "_powers_imag": np.empty((modes, size)),
+                  "_state_to_output": np.empty((modes, size), dtype=np.complex128),
+                  "_input_to_state": np.empty((modes, size), dtype=np.complex128),
+                  "_block_pole": np.empty(modes, dtype=np.complex128),
+                  "_input_to_output": np.empty((size, size))}
+        self._rate_tables[self.sample_rate] = (tables, np.zeros(modes, dtype=bool))
+        for name, array in tables.items():
+            setattr(self, name, array)
+
+    def _compute_coefficients(self):
+        dt = 1.0 / self.sample_rate
+        omega, omega_d, work = self._work
+        np.multiply(self.frequencies, 2.0 * np.pi, out=omega)
+        # Overdamped modes have no oscillatory solution; clamp to a tiny damped frequency
+        # (1e-9 omega) so the recursion stays well defined.
+        np.square(omega, out=omega)
+        np.square(self.decay_rates, out=work)
+        np.subtract(omega, work, out=work)
+        np.multiply(omega, 1e-18, out=omega)
+        np.maximum(work, omega, out=omega_d)
+        np.sqrt(omega_d, out=omega_d)
+        np.multiply(self.decay_rates, -dt, out=self._rates.real)
+        np.multiply(omega_d, dt, out=self._rates.imag)
+        np.exp(self._rates, out=self.poles)
+        flush_denormals(self.poles)
+        # Force enters as dt / omega_d so that Im(z) samples e^{-sigma t} sin(omega_d t) / omega_d
+        np.divide(dt, omega_d, out=self.force_scale)
+        self._silence_above_nyquist(self.force_scale, self.frequencies)
+        self._build_block_matrices()
+
+    def _silence_above_nyquist(self, force_scale, frequencies):
+        # Only after a switch to a lower rate: modes kept from the higher rate take no force
+        nyquist = 0.5 * self.sample_rate
+        if frequencies.size and frequencies.max() >= nyquist:
+            force_scale[frequencies >= nyquist] = 0.0
+
+    def _build_block_matrices(self):
+        # powers[k, n] = p_k^(n + 1) for n = 0 .. size - 1
+        powers = self._powers
+        # Broadcasting ufuncs and mixed real/complex products buffer their operands, so
+        # the scaled tables are complex einsums writing straight into ``out``
+        np.einsum("k,n->kn", self._rates, self._exponents, out=powers)
+        np.exp(powers, out=powers)
+        flush_denormals(powers)
+        drive = self._work[0]
+        scale = self._complex_work
+        np.multiply(self.force_scale, self.input_gains, out=drive)
+        # Output produced by the state carried into the block
+        np.copyto(scale, self.output_gains)
+        np.einsum("k,kn->kn", scale, powers, out=self._state_to_output)
+        np.copyto(self._powers_imag, powers.imag)
+        self._build_input_to_output()
+        # State at the end of the block
+        np.copyto(self._block_pole, powers[:, -1])
+        np.copyto(scale, drive)
+        np.einsum("k,kn->kn", scale, powers[:, ::-1], out=self._input_to_state)
+
+    def _build_input_to_output(self):
+        # Output produced by the excitation inside the block (lower triangular Toeplitz);
+        # every mode contributes, so this is redone in full after a partial update
+        drive, weights = self._work[0], self._work[2]
+        np.multiply(self.force_scale, self.input_gains, out=drive)
+        np.multiply(self.output_gains, drive, out=weights)
+        np.matmul(weights, self._powers_imag, out=self._impulse[:self.block_size])
+        np.take(self._impulse, self._lags, out=self._input_to_output, mode="clip")
+
+    def _compute_modes(self, modes):
+        """Recompute the coefficients of the modes with indices ``modes`` only."""
+        dt = 1.0 / self.sample_rate
+        frequencies, decay_rates = self.frequencies[modes], self.decay_rates[modes]
+        omega = 2.0 * np.pi * frequencies
+        omega_d = np.sqrt(np.maximum(omega**2 - decay_rates**2, 1e-18 * omega**2))
+        rates = (-decay_rates + 1j * omega_d) * dt
+        self.poles[modes] = flush_denormals(np.exp(rates))
+        force_scale = dt / omega_d
+        self._silence_above_nyquist(force_scale, frequencies)
+        self.force_scale[modes] = force_scale
+        powers = flush_denormals(np.exp(rates[:, None] * self._exponents))
+        self._powers_imag[modes] = powers.imag
+        self._state_to_output[modes] = self.output_gains[modes, None] * powers
+        self._block_pole[modes] = powers[:, -1]
+        drive = force_scale * self.input_gains[modes]
+        self._input_to_state[modes] = drive[:, None] * powers[:, ::-1]
+        self._build_input_to_output()
+
+    def _mark_changed(self, modes):
+        # The other rates' coefficients of these modes are recomputed when switched to
+        for rate, (_, changed) in self._rate_tables.items():
+            if rate != self.sample_rate:
+                changed[modes] = True
+
+    def retune(self, frequencies, decay_rates, input_gains=None, output_gains=None):
+        """
+        Load new modes in place, keeping the state (e.g. a pooled bank at note-on).
+
+        Up to ``num_modes`` modes can be given as float64 arrays; the remaining modes are
+        silenced with zero gains. No arrays are allocated, so the new values are not
+        checked against Nyquist beyond a minimum and a maximum.
+        """
+        count = len(frequencies)
+        if count > self.num_modes:
+            raise ValueError(f"Bank holds {self.num_modes} modes, got {count}")
+        if count and (min(frequencies) <= 0.0 or max(frequencies) >= 0.5 * self.sample_rate):
+            raise ValueError("Oscillator frequencies must lie between zero and Nyquist")
+        self.frequencies[:count] = frequencies
+        self.decay_rates[:count] = decay_rates
+        # Silent modes keep a valid tuning so the coefficients stay finite
+        self.frequencies[count:] = 0.25 * self.sample_rate
+        self.decay_rates[count:] = 0.0
+        for gains, values in ((self.input_gains, input_gains), (self.output_gains, output_gains)):
+            gains[:count] = 1.0 if values is None else values
+            gains[count:] = 0.0
+        self._compute_coefficients()
+        self._mark_changed(slice(None))
+
+    def update_modes(self, modes, frequencies=None, decay_rates=None, input_gains=None,
+                     output_gains=None):
+        """
+        Change some modes' parameters, recomputing only their coefficients.
+
+        Suits edits of a single mode or parameter (e.g. a partial's decay from a
+        control); the states are kept. The cost is proportional to the number of
+        modes changed, plus one pass over all modes for the block input-to-output
+        matrix, to which every mode contributes.
+
+        Parameters
+        ----------
+        modes : int or array_like of int
+            Indices of the modes to change.
+        frequencies, decay_rates, input_gains, output_gains : array_like, optional
+            New values for those modes; omitted parameters keep their values.
+        """
+        modes = np.atleast_1d(np.asarray(modes, dtype=np.intp))
+        if frequencies is not None:
+            frequencies = np.asarray(frequencies, dtype=np.float64)
+            if np.any(frequencies <= 0.0) or np.any(frequencies >= 0.5 * self.sample_rate):
+                raise ValueError("Oscillator frequencies must lie between zero and Nyquist")
+        for target, values in ((self.frequencies, frequencies), (self.decay_rates, decay_rates),
+                               (self.input_gains, input_gains), (self.output_gains, output_gains)):
+            if values is not None:
+                target[modes] = values
+        self._compute_modes(modes)
+        self._mark_changed(modes)
+
+    def set_sample_rate(self, sample_rate):
+        """
+        Switch to another sample rate, keeping the state.
+
+        The coefficients of every rate the bank has run at are kept, so switching back
+        to one is a lookup; only modes changed in the meantime (by ``retune`` or
+        ``update_modes``) are recomputed on the way. Modes at or above the new Nyquist
+        frequency are silenced until the rate goes back up.
+        """
+        sample_rate = float(sample_rate)
+        if sample_rate <= 0.0:
+            raise ValueError("The sample rate must be positive")
+        if sample_rate == self.sample_rate:
+            return
+        self.sample_rate = sample_rate
+        entry = self._rate_tables.get(sample_rate)
+        if entry is None:
+            self._add_rate_tables()
+            self._compute_coefficients()
+        else:
+            tables, changed = entry
+            for name, array in tables.items():
+                setattr(self, name, array)
+            if changed.all():
+                self._compute_coefficients()
+            elif changed.any():
+                self._compute_modes(np.flatnonzero(changed))
+            changed[:] = False
+        self.state[self.frequencies >= 0.5 * sample_rate] = 0.0
+
+    def prepare_sample_rates(self, sample_rates=COMMON_SAMPLE_RATES):
+        """
+        Compute the coefficients for several sample rates ahead of a switch.
+
+        Every rate holds its own block matrices, about 40 * num_modes * block_size
+        bytes. The current rate and the state are left as they are.
+        """
+        current, state = self.sample_rate, self.state.copy()
+        for sample_rate in sample_rates:
+            self.set_sample_rate(sample_rate)
+        self.set_sample_rate(current)
+        self.state[:] = state
+
+    def reset(self):
+        """Set every oscillator back to rest."""
+        self.state[:] = 0.0
+
+    def set_displacement(self, displacement):
+        """Place every mode at the given displacement with (approximately) zero velocity."""
+        self.state.real = 0.0
+        self.state.imag = displacement
+
+    @property
+    def displacement(self):
+        """Current displacement of every mode."""
+        return self.state.imag
+
+    @property
+    def force_sensitivity(self):
+        """Change in each modal displacement after one ``step`` per unit of modal force."""
+        return self.poles.imag * self.force_scale
+
+    def free_displacement(self):
+        """Modal displacements that one ``step`` would produce with no force applied."""
+        return np.imag(self.poles * self.state)
+
+    def step(self, excitation=0.0, modal_force=None):
+        """
+        Advance the bank by one sample.
+
+        Parameters
+        ----------
+        excitation : float
+            Scalar excitation weighted by the input gains.
+        modal_force : array_like, optional
+            Additional force applied directly to each mode.
+
+        Returns
+        -------
+        float
+            Output sample after the update.
+        """
+        self._unflushed += 1
+        if self._unflushed == self.block_size:
+            self._unflushed = 0
+            flush_denormals(self.state)
+        force = excitation * self.input_gains
+        if modal_force is not None:
+            force = force + modal_force
+        self.state = self.poles * (self.state + self.force_scale * force)
+        return float(self.output_gains @ self.state.imag)
+
+    def process(self, excitation):
+        """
+        Run the bank over a buffer of scalar excitation samples.
+
+        Parameters
+        ----------
+        excitation : array_like
+            One-dimensional excitation signal.
+
+        Returns
+        -------
+        numpy.ndarray
+            Output signal with the same length as the excitation.
+        """
+        excitation = np.asarray(excitation, dtype=np.float64)
+        output = np.empty(excitation.size)
+        size = self.block_size
+        num_full = excitation.size // size
+        for block in range(num_full):
+            x = excitation[block * size:(block + 1) * size]
+            flush_denormals(self.state)
+            output[block * size:(block + 1) * size] = (
+                np.imag(self.state @ self._state_to_output) + self._input_to_output @ x)
+            self.state = self._block_pole * self.state + self._input_to_state @ x
+        for n in range(num_full * size, excitation.size):
+            output[n] = self.step(excitation[n])
+        return output
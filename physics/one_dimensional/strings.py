@@ -0,0 +1,163 @@
+"""
+Stiff strings in modal coordinates.
+
+The string is pinned at both ends, so mode k has shape sin(k pi x / L) and frequency
+
+    f_k = k f_0 sqrt(1 + B k^2),    f_0 = sqrt(T / mu) / (2 L)
+
+where B is the inharmonicity coefficient. Shapes are mass normalized (unit modal mass),
+which lets other subsystems exchange point forces with the string directly.
+"""
+
+import numpy as np
+
+from physics.one_dimensional.harmonic_oscillators import HarmonicOscillatorBank
+
+
+def note_frequency(note):
+    """Equal-tempered frequency of a MIDI note number (A4 = 69 = 440 Hz)."""
+    return 440.0 * 2.0**((note - 69.0) / 12.0)
+
+
+class ModalString:
+    """
+    A stiff, lossy string represented by a bank of its transverse modes.
+
+    Parameters
+    ----------
+    length : float
+        Speaking length in m.
+    tension : float
+        Tension in N.
+    linear_density : float
+        Mass per unit length in kg/m.
+    sample_rate : float
+        Sample rate in Hz.
+    num_modes : int, optional
+        Number of modes retained. Modes at or above Nyquist are dropped.
+    inharmonicity : float, optional
+        Inharmonicity coefficient B.
+    loss : tuple of float, optional
+        (sigma0, sigma1): mode k decays at sigma0 + sigma1 * omega_k^2 1/s.
+    excitation_position, pickup_position, bridge_position : float, optional
+        Positions as fractions of the length, measured from the nut. The bridge position is
+        where a ``BridgeCoupling`` attaches the string to a body; it has to lie strictly
+        inside the string because every mode shape vanishes at the pinned ends.
+    block_size : int, optional
+        Block length of the oscillator bank's ``process``.
+    """
+
+    def __init__(self, length, tension, linear_density, sample_rate, num_modes=64,
+                 inharmonicity=0.0, loss=(0.5, 2e-6), excitation_position=0.2,
+                 pickup_position=0.9, bridge_position=0.98, block_size=64):
+        self.length = float(length)
+        self.tension = float(tension)
+        self.linear_density = float(linear_density)
+        self.sample_rate = float(sample_rate)
+        self.inharmonicity = float(inharmonicity)
+        self.bridge_position = float(bridge_position)
+        if not 0.0 < self.bridge_position < 1.0:
+            raise ValueError("The bridge position must lie strictly inside the string")
+
+        index = np.arange(1, int(num_modes) + 1)
+        frequencies = (index * self.fundamental
+                       * np.sqrt(1.0 + self.inharmonicity * index**2))
+        index = index[frequencies < 0.5 * self.sample_rate]
+        frequencies = frequencies[:index.size]
+        self.mode_numbers = index
+        omega = 2.0 * np.pi * frequencies
+        sigma0, sigma1 = loss
+        self.oscillators = HarmonicOscillatorBank(
+            frequencies, sigma0 + sigma1 * omega**2, self.sample_rate,
+            input_gains=self.mode_shapes(excitation_position),
+            output_gains=self.mode_shapes(pickup_position), block_size=block_size)
+
+    # Scalar parameters that ``tables`` stores next to the oscillator tables
+    _PARAMETERS = ("length", "tension", "linear_density", "inharmonicity", "bridge_position")
+
+    @classmethod
+    def from_tables(cls, tables):
+        """Rebuild a string from ``tables`` without retuning its oscillator bank."""
+        string = cls.__new__(cls)
+        for name in cls._PARAMETERS:
+            setattr(string, name, float(tables[name]))
+        string.mode_numbers = tables["mode_numbers"]
+        string.oscillators = HarmonicOscillatorBank.from_tables(tables["oscillators"])
+        string.sample_rate = string.oscillators.sample_rate
+        return string
+
+    def tables(self):
+        """Parameters, mode numbers and oscillator tables as a nested dictionary of arrays."""
+        tables = {name: np.array(getattr(self, name)) for name in self._PARAMETERS}
+        tables["mode_numbers"] = self.mode_numbers
+        tables["oscillators"] = self.oscillators.tables()
+        return tables
+
+    @property
+    def fundamental(self):
+        """Fundamental frequency of the ideal (flexible) string in Hz."""
+        return np.sqrt(self.tension / self.linear_density) / (2.0 * self.length)
+
+    @property
+    def num_modes(self):
+        return self.oscillators.num_modes
+
+    def mode_shapes(self, position):
+        """Mass-normalized mode shapes at a position given as a fraction of the length."""
+        norm = np.sqrt(2.0 / (self.linear_density * self.length))
+        return norm * np.sin(np.pi * self.mode_numbers * position)
+
+    @property
+    def bridge_shapes(self):
+        """Mode shapes at the bridge attachment point."""
+        return self.mode_shapes(self.bridge_position)
+
+    def pluck_displacement(self, position, amplitude):
+        """
+        Modal displacements of a triangular pluck shape released from rest.
+
+        Parameters
+        ----------
+        position : float
+            Pluck position as a fraction of the length.
+        amplitude : float
+            Peak displacement in m.
+        """
+        k = self.mode_numbers
+        # Sine series of the triangle, divided by the shape norm to get modal coordinates
+        coefficients = (2.0 * amplitude * np.sin(np.pi * k * position)
+                        / ((np.pi * k)**2 * position * (1.0 - position)))
+        return coefficients / np.sqrt(2.0 / (self.linear_density * self.length))
+
+    def pluck(self, position, amplitude):
+        """Release the string from a triangular shape."""
+        self.oscillators.set_displacement(self.pluck_displacement(position, amplitude))
+
+    def set_sample_rate(self, sample_rate):
+        """
+        Switch the oscillator bank to another sample rate (see
+        ``HarmonicOscillatorBank.set_sample_rate``). The modes are those retained at
+        construction; modes above a lower rate's Nyquist frequency fall silent.
+        """
+        self.oscillators.set_sample_rate(sample_rate)
+        self.sample_rate = self.oscillators.sample_rate
+
+    def reset(self):
+        """Bring the string to rest."""
+        self.oscillators.reset()
+
+    def process(self, excitation):
+        """
+        Drive the string with a point force and return the pickup displacement.
+
+        Parameters
+        ----------
+        excitation : array_like
+            Force signal in N applied at the excitation position.
+
+        Returns
+        -------
+        numpy.ndarray
+            Displacement at the pickup position in m.
+        """
+        return self.oscillators.process(excitation)
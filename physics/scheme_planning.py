@@ -0,0 +1,215 @@
+"""
+Selection of time-stepping scheme, grid and oversampling for finite difference models.
+
+For the family of linear models
+
+    u_tt = c^2 Laplacian u - kappa^2 Laplacian^2 u
+
+in one or two dimensions (strings, bars, membranes, plates), von Neumann analysis of the
+explicit leapfrog scheme with time step k gives the stability bound on the grid spacing
+
+    h^2 >= (d c^2 k^2 + sqrt(d^2 c^4 k^4 + 16 d^2 kappa^2 k^2)) / 2
+
+with d the number of dimensions, while the grid only resolves wavenumbers up to pi / h.
+Implicit (unconditionally stable) schemes lift the bound but pay for a linear solve
+every step. ``plan_scheme`` enumerates explicit and implicit schemes over a set of
+oversampling factors, discards the ones that are unstable, under-resolved or alias the
+nonlinearity, and returns the cheapest with its predicted cost.
+"""
+
+from dataclasses import dataclass, field
+
+import numpy as np
+
+# Multiply-adds per grid point per step for the interior update, keyed by
+# (dimensions, has_stiffness): 3- and 5-point stencils in 1D, 5- and 13-point in 2D,
+# plus the leapfrog time update.
+_STENCIL_OPS = {(1, False): 3 + 3, (1, True): 5 + 3, (2, False): 5 + 3, (2, True): 13 + 3}
+# Banded LU forward/back substitution per point in 1D (tridiagonal / pentadiagonal)
+_BANDED_SOLVE_OPS = {False: 5, True: 9}
+# Multiply-adds per output sample of a polyphase decimator, per unit of oversampling
+_DECIMATION_OPS = 24
+
+
+@dataclass
+class ModelParameters:
+    """
+    Physical description of a finite difference model.
+
+    Parameters
+    ----------
+    size : tuple of float
+        Domain extent in m: (length,) for strings and bars, (width, height) for 2D.
+    wave_speed : float
+        Transverse wave speed c in m/s (zero for pure bending).
+    stiffness : float
+        Stiffness parameter kappa in m^2/s (sqrt(E I / (rho A)) for bars,
+        sqrt(D / (rho h)) for plates).
+    nonlinearity : float
+        Strength of the nonlinearity from 0 (linear) to 1. It raises the effective wave
+        speed and stiffness by that fraction for the stability bound, and widens the
+        band the internal rate has to carry by up to three times (cubic distortion).
+    max_frequency : float
+        Highest frequency that has to be represented, in Hz.
+    """
+
+    size: tuple
+    wave_speed: float
+    stiffness: float = 0.0
+    nonlinearity: float = 0.0
+    max_frequency: float = 20000.0
+
+    @property
+    def dimensions(self):
+        return len(self.size)
+
+    def wavenumber(self, frequency):
+        """Wavenumber in rad/m at which the continuous model oscillates at ``frequency``."""
+        omega = 2.0 * np.pi * frequency
+        if self.stiffness == 0.0:
+            return omega / self.wave_speed
+        c2, k2 = self.wave_speed**2, self.stiffness**2
+        return np.sqrt((-c2 + np.sqrt(c2**2 + 4.0 * k2 * omega**2)) / (2.0 * k2))
+
+
+@dataclass
+class SchemePlan:
+    """
+    A concrete configuration and its predicted cost.
+
+    Attributes
+    ----------
+    scheme : str
+        ``"explicit"`` or ``"implicit"``.
+    oversampling : int
+        Internal rate as a multiple of the host rate.
+    internal_rate : float
+        Rate at which the scheme is stepped, in Hz.
+    grid_points : tuple of int
+        Interior grid points per dimension.
+    grid_spacing : float
+        Grid spacing in m.
+    ops_per_second : float
+        Predicted multiply-adds per second of audio, including decimation.
+    stability_margin : float
+        Ratio of the chosen spacing to the smallest stable explicit spacing (always at
+        least one for explicit plans; informational for implicit ones).
+    rejected : list of str
+        Why the other candidates were discarded, for reporting.
+    """
+
+    scheme: str
+    oversampling: int
+    internal_rate: float
+    grid_points: tuple
+    grid_spacing: float
+    ops_per_second: float
+    stability_margin: float
+    rejected: list = field(default_factory=list)
+
+    @property
+    def num_points(self):
+        return int(np.prod(self.grid_points))
+
+    def report(self):
+        """One-line human readable summary."""
+        points = " x ".join(str(n) for n in self.grid_points)
+        return (f"{self.scheme} scheme at {self.oversampling}x ({self.internal_rate:.0f} Hz), "
+                f"{points} grid (h = {self.grid_spacing * 1e3:.3g} mm), "
+                f"{self.ops_per_second / 1e6:.1f} Mop/s")
+
+
+def stable_spacing(model, time_step):
+    """Smallest grid spacing for which the explicit scheme is stable."""
+    d = model.dimensions
+    scale = 1.0 + model.nonlinearity
+    c2k2 = (scale * model.wave_speed * time_step)**2
+    kappa_k = scale * model.stiffness * time_step
+    return np.sqrt(0.5 * (d * c2k2 + np.sqrt((d * c2k2)**2 + 16.0 * d**2 * kappa_k**2)))
+
+
+def _multigrid_ops(points, stencil_ops, cycles=3):
+    # Two pre- and two post-smoothing sweeps, a residual and the conjugate gradient update
+    # per cycle, with the coarse grids adding a third on top of the finest level.
+    return cycles * (4 + 1 + 2) * stencil_ops * points * 4.0 / 3.0
+
+
+def _cost(model, scheme, points, oversampling, sample_rate):
+    stiff = model.stiffness > 0.0
+    stencil = _STENCIL_OPS[(model.dimensions, stiff)]
+    per_step = stencil * points
+    if scheme == "implicit":
+        if model.dimensions == 1:
+            per_step += _BANDED_SOLVE_OPS[stiff] * points
+        else:
+            per_step += _multigrid_ops(points, stencil)
+    decimation = _DECIMATION_OPS * oversampling if oversampling > 1 else 0
+    return (per_step * oversampling + decimation) * sample_rate
+
+
+def plan_scheme(model, sample_rate, oversampling_factors=(1, 2, 4, 8), min_points=8):
+    """
+    Choose the cheapest stable, sufficiently resolved configuration for a model.
+
+    Parameters
+    ----------
+    model : ModelParameters
+        Physical description of the model.
+    sample_rate : float
+        Host sample rate in Hz.
+    oversampling_factors : sequence of int, optional
+        Internal oversampling factors to consider.
+    min_points : int, optional
+        Minimum number of grid intervals along each dimension.
+
+    Returns
+    -------
+    SchemePlan
+        The cheapest viable plan, with the reasons the other candidates were rejected.
+
+    Raises
+    ------
+    ValueError
+        If no candidate is viable.
+    """
+    # The spacing must resolve the highest wavenumber of interest...
+    resolving_spacing = np.pi / model.wavenumber(model.max_frequency)
+    # ...and the internal Nyquist must cover the band widened by the nonlinearity.
+    required_rate = 2.0 * model.max_frequency * (1.0 + 2.0 * model.nonlinearity)
+    shortest = min(model.size)
+
+    candidates, rejected = [], []
+    for factor in oversampling_factors:
+        rate = sample_rate * factor
+        if rate < required_rate:
+            rejected.append(f"{factor}x: internal rate {rate:.0f} Hz aliases the nonlinearity")
+            continue
+        h_min = stable_spacing(model, 1.0 / rate)
+        for scheme in ("explicit", "implicit"):
+            if scheme == "explicit":
+                intervals = [int(np.floor(length / h_min)) for length in model.size]
+                if min(intervals) < min_points:
+                    rejected.append(f"explicit {factor}x: stable grid too coarse "
+                                    f"({min(intervals)} intervals)")
+                    continue
+                spacing = max(length / n for length, n in zip(model.size, intervals))
+                if spacing > resolving_spacing:
+                    rejected.append(f"explicit {factor}x: h = {spacing:.3g} m cannot resolve "
+                                    f"{model.max_frequency:.0f} Hz")
+                    continue
+            else:
+                spacing = min(resolving_spacing, shortest / min_points)
+                intervals = [int(np.ceil(length / spacing)) for length in model.size]
+                spacing = max(length / n for length, n in zip(model.size, intervals))
+            points = tuple(n - 1 for n in intervals)
+            cost = _cost(model, scheme, int(np.prod(points)), factor, sample_rate)
+            candidates.append(SchemePlan(scheme, factor, rate, points, spacing, cost,
+                                         spacing / h_min))
+
+    if not candidates:
+        raise ValueError("No stable configuration: " + "; ".join(rejected))
+    best = min(candidates, key=lambda plan: plan.ops_per_second)
+    best.rejected = rejected + [f"{plan.scheme} {plan.oversampling}x: "
+                                f"{plan.ops_per_second / 1e6:.1f} Mop/s"
+                                for plan in candidates if plan is not best]
+    return best
@@ -0,0 +1,351 @@
+"""
+Thin plate models in modal coordinates.
+
+The von Karman plate couples transverse displacement w to the Airy stress function F:
+
+    rho h w_tt = -D laplacian^2 w + L(w, F) + forcing
+    laplacian^2 F = -(E h / 2) L(w, w)
+
+with L(f, g) = f_xx g_yy + f_yy g_xx - 2 f_xy g_xy. Projecting onto transverse modes
+Phi_k (sine series, simply supported) and in-plane modes Psi_n (cosine series, the
+classical Levy expansion for movable edges) gives a third-order coupling tensor
+
+    H[n, p, q] = integral of Psi_n L(Phi_p, Phi_q) over the plate
+
+and the cubic modal force is sum_n H[n, k, p] q_p eta_n with
+eta_n = -(E h / (2 zeta_n^4)) sum_pq H[n, p, q] q_p q_q. The tensor is stored scaled by
+1 / zeta_n^2, which splits the stiffness evenly between the two contractions and makes
+pruning by magnitude reflect each entry's actual contribution. The fourth-order tensor is
+never formed: applying it as two contractions of the sparse third-order tensor costs
+O(nnz) per sample instead of O(N^4). With the cosine basis the integrals obey exact
+selection rules, leaving at most four in-plane partners per transverse pair, so nnz grows
+as N^2.
+"""
+
+import numpy as np
+
+from physics.one_dimensional.harmonic_oscillators import HarmonicOscillatorBank
+
+
+def _selection_integrals(c, a, b, length):
+    """
+    Integrals over [0, length] of cos_c sin_a sin_b and cos_c cos_a cos_b, where
+    trig_k(x) = trig(k pi x / length) for non-negative integers c and positive a, b.
+    """
+    difference = (c == np.abs(a - b)).astype(np.float64)
+    total = (c == a + b).astype(np.float64)
+    # For a == b and c == 0 both difference terms of the product formula contribute
+    difference *= np.where(a == b, 2.0, 1.0)
+    return 0.25 * length * (difference - total), 0.25 * length * (difference + total)
+
+
+def _lowest_modes(count, width, height, first_index=1):
+    """
+    Wavenumber pairs (m, n) of the ``count`` lowest modes of a rectangle, ordered by
+    m^2 / width^2 + n^2 / height^2. Indices start at ``first_index``; the (0, 0) pair is
+    always excluded.
+    """
+    # Start from the quarter ellipse holding about ``count`` lattice points and grow the
+    # box until the count-th lowest mode lies strictly inside it, so none is cut off
+    radius = np.sqrt(4.0 * count / (np.pi * width * height))
+    max_m, max_n = int(np.ceil(radius * width)) + 2, int(np.ceil(radius * height)) + 2
+    while True:
+        m, n = np.meshgrid(np.arange(first_index, max_m + 1), np.arange(first_index, max_n + 1),
+                           indexing="ij")
+        m, n = m.ravel(), n.ravel()
+        keep = (m > 0) | (n > 0)
+        m, n = m[keep], n[keep]
+        wavenumbers = (m / width)**2 + (n / height)**2
+        order = np.argsort(wavenumbers, kind="stable")[:count]
+        if order.size == count:
+            largest = wavenumbers[order[-1]]
+            if largest < min(((max_m + 1) / width)**2, ((max_n + 1) / height)**2):
+                break
+        max_m, max_n = 2 * max_m, 2 * max_n
+    return m[order], n[order]
+
+
+class SparseCouplingTensor:
+    """
+    Pruned third-order coupling tensor H[n, p, q] stored in coordinate form.
+
+    Both contractions needed by the von Karman force are evaluated with ``numpy.bincount``
+    over the stored entries, so the cost per sample is proportional to the number of
+    retained coefficients.
+
+    Parameters
+    ----------
+    in_plane, first, second : numpy.ndarray
+        Integer index arrays of the retained entries.
+    values : numpy.ndarray
+        Coefficient values.
+    num_in_plane, num_transverse : int
+        Tensor dimensions.
+    """
+
+    def __init__(self, in_plane, first, second, values, num_in_plane, num_transverse):
+        # 32-bit indices halve the memory traffic of the gathers in the contractions
+        self.in_plane = np.asarray(in_plane, dtype=np.int32)
+        self.first = np.asarray(first, dtype=np.int32)
+        self.second = np.asarray(second, dtype=np.int32)
+        self.values = np.asarray(values, dtype=np.float64)
+        self.num_in_plane = int(num_in_plane)
+        self.num_transverse = int(num_transverse)
+
+    @property
+    def nnz(self):
+        """Number of stored coefficients."""
+        return self.values.size
+
+    def tables(self):
+        """Entries and dimensions as arrays, for ``SparseCouplingTensor(**tables)``."""
+        return {"in_plane": self.in_plane, "first": self.first, "second": self.second,
+                "values": self.values, "num_in_plane": np.array(self.num_in_plane),
+                "num_transverse": np.array(self.num_transverse)}
+
+    def pruned(self, tolerance):
+        """Return a copy without the entries smaller than ``tolerance`` times the largest."""
+        if self.nnz == 0:
+            return self
+        keep = np.abs(self.values) >= tolerance * np.max(np.abs(self.values))
+        return SparseCouplingTensor(self.in_plane[keep], self.first[keep], self.second[keep],
+                                    self.values[keep], self.num_in_plane, self.num_transverse)
+
+    def contract_pair(self, displacement):
+        """Return sum_pq H[n, p, q] q_p q_q for every in-plane mode n."""
+        weights = self.values * displacement[self.first] * displacement[self.second]
+        return np.bincount(self.in_plane, weights=weights, minlength=self.num_in_plane)
+
+    def contract_force(self, stress, displacement):
+        """Return sum_np H[n, k, p] eta_n q_p for every transverse mode k."""
+        weights = self.values * stress[self.in_plane] * displacement[self.second]
+        return np.bincount(self.first, weights=weights, minlength=self.num_transverse)
+
+
+class VonKarmanPlate:
+    """
+    Simply supported rectangular von Karman plate in modal coordinates.
+
+    Suitable for gongs and cymbals in the geometrically nonlinear regime. The linear part
+    of each mode is advanced exactly by a ``HarmonicOscillatorBank``; the cubic coupling is
+    applied explicitly as a modal force once per sample.
+
+    Parameters
+    ----------
+    width, height : float
+        Plate side lengths in m.
+    thickness : float
+        Plate thickness in m.
+    density : float
+        Material density in kg/m^3.
+    youngs_modulus : float
+        Young's modulus in Pa.
+    poisson_ratio : float
+        Poisson's ratio.
+    num_modes : int
+        Number of transverse modes retained.
+    sample_rate : float
+        Sample rate in Hz.
+    num_in_plane_modes : int, optional
+        Number of in-plane (Airy stress) modes. Defaults to twice ``num_modes``, since the
+        coupling reaches in-plane wavenumbers up to the sum of two transverse ones.
+    excitation_point, pickup_point : tuple of float, optional
+        Positions as fractions of (width, height).
+    loss : tuple of float, optional
+        (sigma0, sigma1): mode k decays at sigma0 + sigma1 * omega_k^2 1/s.
+    prune_tolerance : float, optional
+        Coupling coefficients smaller than this fraction of the largest are discarded.
+    block_size : int, optional
+        Block length of the oscillator bank's ``process``.
+    """
+
+    def __init__(self, width, height, thickness, density, youngs_modulus, poisson_ratio, num_modes,
+                 sample_rate, num_in_plane_modes=None, excitation_point=(0.37, 0.41),
+                 pickup_point=(0.63, 0.29), loss=(1.0, 1e-9), prune_tolerance=1e-3,
+                 block_size=64):
+        self.width = float(width)
+        self.height = float(height)
+        self.thickness = float(thickness)
+        self.density = float(density)
+        self.youngs_modulus = float(youngs_modulus)
+        self.poisson_ratio = float(poisson_ratio)
+        self.sample_rate = float(sample_rate)
+        if num_in_plane_modes is None:
+            num_in_plane_modes = 2 * num_modes
+
+        self.mass_per_area = self.density * self.thickness
+        self.rigidity = (self.youngs_modulus * self.thickness**3
+                         / (12.0 * (1.0 - self.poisson_ratio**2)))
+
+        m, n = _lowest_modes(num_modes, self.width, self.height)
+        self.wavenumbers_x = np.pi * m / self.width
+        self.wavenumbers_y = np.pi * n / self.height
+        self._mode_indices = (m, n)
+        wavenumber_sq = self.wavenumbers_x**2 + self.wavenumbers_y**2
+        omega = np.sqrt(self.rigidity / self.mass_per_area) * wavenumber_sq
+        nyquist = np.pi * self.sample_rate
+        if omega[-1] >= nyquist:
+            raise ValueError("Highest plate mode lies above Nyquist; reduce num_modes or raise "
+                             "the sample rate")
+
+        fm, fn = _lowest_modes(num_in_plane_modes, self.width, self.height, first_index=0)
+        self._in_plane_indices = (fm, fn)
+        self.in_plane_stiffness = ((np.pi * fm / self.width)**2 + (np.pi * fn / self.height)**2)**2
+
+        # Coupling tensor H[n, p, q] / zeta_n^2
+        self.coupling = self._build_coupling(prune_tolerance)
+
+        sigma0, sigma1 = loss
+        self.oscillators = HarmonicOscillatorBank(
+            omega / (2.0 * np.pi), sigma0 + sigma1 * omega**2, self.sample_rate,
+            input_gains=self.mode_shapes(*excitation_point) / self.mass_per_area,
+            output_gains=self.mode_shapes(*pickup_point), block_size=block_size)
+
+    # Material and geometry stored by ``tables``; the rest is derived from them or tabulated
+    _PARAMETERS = ("width", "height", "thickness", "density", "youngs_modulus", "poisson_ratio")
+
+    @classmethod
+    def from_tables(cls, tables):
+        """Rebuild a plate from ``tables`` without recomputing its modes or coupling tensor."""
+        plate = cls.__new__(cls)
+        for name in cls._PARAMETERS:
+            setattr(plate, name, float(tables[name]))
+        plate.mass_per_area = plate.density * plate.thickness
+        plate.rigidity = (plate.youngs_modulus * plate.thickness**3
+                          / (12.0 * (1.0 - plate.poisson_ratio**2)))
+        plate.wavenumbers_x = tables["wavenumbers_x"]
+        plate.wavenumbers_y = tables["wavenumbers_y"]
+        plate._mode_indices = tuple(tables["mode_indices"])
+        plate._in_plane_indices = tuple(tables["in_plane_indices"])
+        plate.in_plane_stiffness = tables["in_plane_stiffness"]
+        plate.coupling = SparseCouplingTensor(**tables["coupling"])
+        plate.oscillators = HarmonicOscillatorBank.from_tables(tables["oscillators"])
+        plate.sample_rate = plate.oscillators.sample_rate
+        return plate
+
+    def tables(self):
+        """Parameters, mode tables and coupling tensor as a nested dictionary of arrays."""
+        tables = {name: np.array(getattr(self, name)) for name in self._PARAMETERS}
+        tables.update(wavenumbers_x=self.wavenumbers_x, wavenumbers_y=self.wavenumbers_y,
+                      mode_indices=np.stack(self._mode_indices),
+                      in_plane_indices=np.stack(self._in_plane_indices),
+                      in_plane_stiffness=self.in_plane_stiffness,
+                      coupling=self.coupling.tables(), oscillators=self.oscillators.tables())
+        return tables
+
+    @property
+    def num_modes(self):
+        return self.oscillators.num_modes
+
+    def mode_shapes(self, x_fraction, y_fraction):
+        """
+        Transverse mode shapes evaluated at a point on the plate, normalized so that their
+        squares integrate to one over the plate (modal mass ``mass_per_area``).
+        """
+        norm = 2.0 / np.sqrt(self.width * self.height)
+        x_fraction = np.asarray(x_fraction)
+        y_fraction = np.asarray(y_fraction)
+        ax = self.wavenumbers_x.reshape(self.wavenumbers_x.shape + (1,) * x_fraction.ndim)
+        ay = self.wavenumbers_y.reshape(self.wavenumbers_y.shape + (1,) * y_fraction.ndim)
+        return (norm * np.sin(ax * x_fraction * self.width)
+                * np.sin(ay * y_fraction * self.height))
+
+    def surface_grid(self, num_x, num_y):
+        """
+        Element centres, element area and mode shapes on a regular grid over the plate.
+
+        Returns
+        -------
+        tuple
+            Positions of shape (num_x * num_y, 2), the element area, and mode shapes of
+            shape (num_modes, num_x * num_y), as used by the radiation models.
+        """
+        x = (np.arange(num_x) + 0.5) / num_x
+        y = (np.arange(num_y) + 0.5) / num_y
+        fx, fy = (grid.ravel() for grid in np.meshgrid(x, y, indexing="ij"))
+        positions = np.stack([fx * self.width, fy * self.height], axis=1)
+        shapes = self.mode_shapes(fx, fy)
+        return positions, self.width * self.height / (num_x * num_y), shapes
+
+    def _build_coupling(self, prune_tolerance):
+        m, n = self._mode_indices
+        fm, fn = self._in_plane_indices
+        ax, ay = self.wavenumbers_x, self.wavenumbers_y
+        # Only in-plane wavenumbers |m_p - m_q| and m_p + m_q (likewise in y) couple a pair
+        # of transverse modes, so enumerate those candidates instead of the dense tensor.
+        lookup = -np.ones((fm.max() + 1, fn.max() + 1), dtype=np.intp)
+        lookup[fm, fn] = np.arange(fm.size)
+        p, q = (index.ravel() for index in np.indices((m.size, m.size)))
+        entries = []
+        for cx in (np.abs(m[p] - m[q]), m[p] + m[q]):
+            for cy in (np.abs(n[p] - n[q]), n[p] + n[q]):
+                inside = (cx < lookup.shape[0]) & (cy < lookup.shape[1])
+                target = np.full(p.size, -1)
+                target[inside] = lookup[cx[inside], cy[inside]]
+                valid = target >= 0
+                pv, qv, cxv, cyv = p[valid], q[valid], cx[valid], cy[valid]
+                sine_x, cosine_x = _selection_integrals(cxv, m[pv], m[qv], self.width)
+                sine_y, cosine_y = _selection_integrals(cyv, n[pv], n[qv], self.height)
+                norm = (4.0 / (self.width * self.height)
+                        * np.where(cxv > 0, np.sqrt(2.0 / self.width), np.sqrt(1.0 / self.width))
+                        * np.where(cyv > 0, np.sqrt(2.0 / self.height), np.sqrt(1.0 / self.height)))
+                values = norm / np.sqrt(self.in_plane_stiffness[target[valid]]) * (
+                    (ax[pv]**2 * ay[qv]**2 + ay[pv]**2 * ax[qv]**2) * sine_x * sine_y
+                    - 2.0 * ax[pv] * ay[pv] * ax[qv] * ay[qv] * cosine_x * cosine_y)
+                entries.append((target[valid], pv, qv, values))
+        in_plane, first, second, values = (np.concatenate(parts) for parts in zip(*entries))
+        nonzero = values != 0.0
+        return SparseCouplingTensor(in_plane[nonzero], first[nonzero], second[nonzero],
+                                    values[nonzero], fm.size, m.size).pruned(prune_tolerance)
+
+    def set_sample_rate(self, sample_rate):
+        """
+        Switch the linear part to another sample rate; the coupling tensor does not
+        depend on it.
+        """
+        self.oscillators.set_sample_rate(sample_rate)
+        self.sample_rate = self.oscillators.sample_rate
+
+    def reset(self):
+        """Bring the plate to rest."""
+        self.oscillators.reset()
+
+    def nonlinear_force(self, displacement):
+        """Modal force per unit mass produced by the von Karman coupling."""
+        stress = self.coupling.contract_pair(displacement)
+        scale = -0.5 * self.youngs_modulus * self.thickness / self.mass_per_area
+        return scale * self.coupling.contract_force(stress, displacement)
+
+    def process(self, excitation):
+        """
+        Drive the plate with a point force and return the pickup displacement.
+
+        Parameters
+        ----------
+        excitation : array_like
+            Force signal in N applied at the excitation point.
+
+        Returns
+        -------
+        numpy.ndarray
+            Displacement at the pickup point in m.
+        """
+        excitation = np.asarray(excitation, dtype=np.float64)
+        output = np.empty(excitation.size)
+        bank = self.oscillators
+        for i, force in enumerate(excitation):
+            output[i] = bank.step(force, self.nonlinear_force(bank.displacement))
+        return output
+
+    def process_modal(self, excitation):
+        """
+        Like ``process``, but return the displacement of every mode, shape
+        (num_modes, num_samples), for radiation or analysis.
+        """
+        excitation = np.asarray(excitation, dtype=np.float64)
+        displacements = np.empty((self.num_modes, excitation.size))
+        bank = self.oscillators
+        for i, force in enumerate(excitation):
+            bank.step(force, self.nonlinear_force(bank.displacement))
+            displacements[:, i] = bank.displacement
+        return displacements
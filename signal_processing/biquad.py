@@ -0,0 +1,279 @@
+"""
+Cascades of second-order sections for many channels at once.
+
+Sections are given as rows (b0, b1, b2, a0, a1, a2), the same layout as ``scipy.signal``
+second-order sections, and are normalized so a0 = 1. Two processing paths are provided:
+
+* ``BiquadCascade`` runs the transposed direct form II recursion sample by sample, with
+  coefficients and state stored as (sections, channels) arrays so every update is one
+  vector operation across all channels (voices). Coefficients can be changed between
+  blocks at no cost, which suits modulated filters.
+* ``BlockBiquadCascade`` uses block state-space (lookahead) processing: the cascade is
+  written as one state-space system, and the response to a whole block of N samples is
+  a product with precomputed N x N, N x S and S x N matrices (S = 2 x sections). This
+  turns the recursion into matrix products, and with shared coefficients all channels
+  go through a single matrix multiply. Coefficient changes rebuild the matrices.
+
+Both flush subnormal states to zero at the start of every block, so a filter ringing out
+does not slow down as its state decays.
+"""
+
+import numpy as np
+
+from signal_processing.denormals import flush_denormals
+
+
+def normalize_sos(sos):
+    """Return sections as an array of shape (..., sections, 5) of (b0, b1, b2, a1, a2)."""
+    sos = np.asarray(sos, dtype=np.float64)
+    if sos.shape[-1] != 6:
+        raise ValueError("Second-order sections must have six coefficients per row")
+    a0 = sos[..., 3:4]
+    return np.concatenate([sos[..., 0:3], sos[..., 4:6]], axis=-1) / a0
+
+
+def peaking(frequency, q, gain_db, sample_rate):
+    """Peaking equalizer section (RBJ cookbook) as a (b0, b1, b2, a0, a1, a2) row."""
+    amplitude = 10.0**(gain_db / 40.0)
+    w0 = 2.0 * np.pi * frequency / sample_rate
+    alpha = np.sin(w0) / (2.0 * q)
+    cos = np.cos(w0)
+    return np.array([1.0 + alpha * amplitude, -2.0 * cos, 1.0 - alpha * amplitude,
+                     1.0 + alpha / amplitude, -2.0 * cos, 1.0 - alpha / amplitude])
+
+
+def lowpass(frequency, q, sample_rate):
+    """Second-order lowpass section (RBJ cookbook) as a (b0, b1, b2, a0, a1, a2) row."""
+    w0 = 2.0 * np.pi * frequency / sample_rate
+    alpha = np.sin(w0) / (2.0 * q)
+    cos = np.cos(w0)
+    return np.array([(1.0 - cos) / 2.0, 1.0 - cos, (1.0 - cos) / 2.0,
+                     1.0 + alpha, -2.0 * cos, 1.0 - alpha])
+
+
+def highpass(frequency, q, sample_rate):
+    """Second-order highpass section (RBJ cookbook) as a (b0, b1, b2, a0, a1, a2) row."""
+    w0 = 2.0 * np.pi * frequency / sample_rate
+    alpha = np.sin(w0) / (2.0 * q)
+    cos = np.cos(w0)
+    return np.array([(1.0 + cos) / 2.0, -(1.0 + cos), (1.0 + cos) / 2.0,
+                     1.0 + alpha, -2.0 * cos, 1.0 - alpha])
+
+
+class BiquadCascade:
+    """
+    Transposed direct form II cascade, vectorized across channels.
+
+    Parameters
+    ----------
+    sos : array_like
+        Sections of shape (sections, 6) shared by all channels, or
+        (channels, sections, 6) per channel.
+    num_channels : int
+        Number of channels processed together.
+    """
+
+    def __init__(self, sos, num_channels):
+        self.num_channels = int(num_channels)
+        self.set_coefficients(sos)
+        self.state = np.zeros((2, self.num_sections, self.num_channels))
+
+    def set_coefficients(self, sos):
+        """Replace the coefficients, keeping the filter state."""
+        sections = normalize_sos(sos)
+        if sections.ndim == 2:
+            sections = np.broadcast_to(sections, (self.num_channels,) + sections.shape)
+        if sections.shape[0] != self.num_channels:
+            raise ValueError("Per-channel sections must have num_channels rows")
+        # (coefficient, section, channel): each coefficient row is contiguous over channels
+        self.coefficients = np.ascontiguousarray(np.transpose(sections, (2, 1, 0)))
+        self.num_sections = self.coefficients.shape[1]
+
+    def reset(self):
+        """Clear the filter state."""
+        self.state[:] = 0.0
+
+    def process(self, x):
+        """
+        Filter a block.
+
+        Parameters
+        ----------
+        x : array_like
+            Input of shape (channels, samples).
+
+        Returns
+        -------
+        numpy.ndarray
+            Output of shape (channels, samples).
+        """
+        x = np.asarray(x, dtype=np.float64)
+        output = np.empty_like(x)
+        b0, b1, b2, a1, a2 = self.coefficients
+        s1, s2 = flush_denormals(self.state)
+        for n in range(x.shape[1]):
+            signal = x[:, n]
+            for k in range(self.num_sections):
+                y = b0[k] * signal + s1[k]
+                s1[k] = b1[k] * signal - a1[k] * y + s2[k]
+                s2[k] = b2[k] * signal - a2[k] * y
+                signal = y
+            output[:, n] = signal
+        return output
+
+
+def _state_space(sections):
+    """
+    State-space matrices (A, B, C, D) of a TDF-II cascade, batched over leading axes.
+
+    The state vector stacks the two TDF-II states of every section in order.
+    """
+    batch = sections.shape[:-2]
+    count = sections.shape[-2]
+    size = 2 * count
+    a = np.zeros(batch + (size, size))
+    b = np.zeros(batch + (size,))
+    c = np.zeros(batch + (size,))
+    d = np.ones(batch)
+    for k in range(count):
+        b0, b1, b2, a1, a2 = np.moveaxis(sections[..., k, :], -1, 0)
+        i = 2 * k
+        # Section input u = d_prev x + c_prev s; output y = b0 u + s1
+        #   s1' = (b1 - a1 b0) u - a1 s1 + s2,  s2' = (b2 - a2 b0) u - a2 s1
+        drive = np.stack([b1 - a1 * b0, b2 - a2 * b0], axis=-1)
+        a[..., i:i + 2, :i] = drive[..., :, None] * c[..., None, :i]
+        a[..., i, i] = -a1
+        a[..., i, i + 1] = 1.0
+        a[..., i + 1, i] = -a2
+        b[..., i:i + 2] = drive * d[..., None]
+        c[..., :i] *= b0[..., None]
+        c[..., i] = 1.0
+        d = d * b0
+    return a, b, c, d
+
+
+class BlockBiquadCascade:
+    """
+    Block state-space (lookahead) implementation of a biquad cascade.
+
+    Parameters
+    ----------
+    sos : array_like
+        Sections of shape (sections, 6) shared by all channels, or
+        (channels, sections, 6) per channel.
+    num_channels : int
+        Number of channels processed together.
+    block_size : int, optional
+        Length of the blocks processed with matrix products.
+    """
+
+    def __init__(self, sos, num_channels, block_size=64):
+        self.num_channels = int(num_channels)
+        self.block_size = int(block_size)
+        self.set_coefficients(sos)
+
+    def set_coefficients(self, sos):
+        """Replace the coefficients and rebuild the block matrices (state is reset)."""
+        sections = normalize_sos(sos)
+        self.shared = sections.ndim == 2
+        if not self.shared and sections.shape[0] != self.num_channels:
+            raise ValueError("Per-channel sections must have num_channels rows")
+        a, b, c, d = _state_space(sections)
+        size = self.block_size
+        order = a.shape[-1]
+        # observe[n] = C A^n, reach[:, j] = A^(N-1-j) B, impulse[m] = C A^(m-1) B for m >= 1
+        observe = np.empty(a.shape[:-2] + (size, order))
+        power = np.broadcast_to(np.eye(order), a.shape).copy()
+        for n in range(size):
+            observe[..., n, :] = np.einsum("...i,...ij->...j", c, power)
+            power = power @ a
+        self._transition = power
+        responses = np.einsum("...ni,...i->...n", observe, b)[..., :-1]
+        impulse = np.concatenate([d[..., None], responses], axis=-1)
+        lags = np.arange(size)[:, None] - np.arange(size)[None, :]
+        self._toeplitz = np.where(lags >= 0, np.take(impulse, np.clip(lags, 0, None), axis=-1), 0.0)
+        self._observe = observe
+        self._reach = self._build_reach(a, b, size)
+        self._step = (a, b, c, d)
+        self.state = np.zeros((self.num_channels, order))
+
+    @classmethod
+    def from_tables(cls, tables):
+        """Rebuild a cascade from ``tables`` without recomputing the block matrices."""
+        cascade = cls.__new__(cls)
+        cascade.num_channels = int(tables["num_channels"])
+        cascade.shared = bool(tables["shared"])
+        cascade._transition = tables["transition"]
+        cascade._toeplitz = tables["toeplitz"]
+        cascade._observe = tables["observe"]
+        cascade._reach = tables["reach"]
+        cascade._step = tuple(tables[name] for name in "abcd")
+        cascade.block_size = cascade._toeplitz.shape[-1]
+        cascade.state = np.zeros((cascade.num_channels, cascade._transition.shape[-1]))
+        return cascade
+
+    def tables(self):
+        """Block matrices and the per-sample state-space system as arrays."""
+        tables = dict(zip("abcd", self._step))
+        tables.update(num_channels=np.array(self.num_channels), shared=np.array(self.shared),
+                      transition=self._transition, toeplitz=self._toeplitz,
+                      observe=self._observe, reach=self._reach)
+        return tables
+
+    @staticmethod
+    def _build_reach(a, b, size):
+        columns = [b]
+        for _ in range(size - 1):
+            columns.append(np.einsum("...ij,...j->...i", a, columns[-1]))
+        # Column j multiplies x[j], which is N - 1 - j steps old at the end of the block
+        return np.stack(columns[::-1], axis=-1)
+
+    def reset(self):
+        """Clear the filter state."""
+        self.state[:] = 0.0
+
+    def _process_block(self, x):
+        flush_denormals(self.state)
+        if self.shared:
+            output = x @ self._toeplitz.T + self.state @ self._observe.T
+            self.state = self.state @ self._transition.T + x @ self._reach.T
+        else:
+            output = (np.einsum("cnj,cj->cn", self._toeplitz, x)
+                      + np.einsum("cni,ci->cn", self._observe, self.state))
+            self.state = (np.einsum("cij,cj->ci", self._transition, self.state)
+                          + np.einsum("cin,cn->ci", self._reach, x))
+        return output
+
+    def _process_sample(self, x):
+        a, b, c, d = self._step
+        if self.shared:
+            output = self.state @ c + d * x
+            self.state = self.state @ a.T + x[:, None] * b
+        else:
+            output = np.einsum("ci,ci->c", self.state, c) + d * x
+            self.state = np.einsum("cij,cj->ci", a, self.state) + x[:, None] * b
+        return output
+
+    def process(self, x):
+        """
+        Filter a block.
+
+        Parameters
+        ----------
+        x : array_like
+            Input of shape (channels, samples).
+
+        Returns
+        -------
+        numpy.ndarray
+            Output of shape (channels, samples).
+        """
+        x = np.asarray(x, dtype=np.float64)
+        output = np.empty_like(x)
+        size = self.block_size
+        full = x.shape[1] // size * size
+        for start in range(0, full, size):
+            output[:, start:start + size] = self._process_block(x[:, start:start + size])
+        for n in range(full, x.shape[1]):
+            output[:, n] = self._process_sample(x[:, n])
+        return output
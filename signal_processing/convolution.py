@@ -0,0 +1,276 @@
+"""
+Low-latency convolution with long impulse responses.
+
+``PartitionedConvolver`` splits the impulse response into
+
+* a direct-form head covering the first block, so the output has no latency;
+* a run of uniform partitions of one block each, applied with uniformly partitioned
+  overlap-save (a frequency-domain delay line) on the calling thread;
+* stages of geometrically growing partitions (2, 4, 8, ... blocks), each computed on a
+  background thread.
+
+A stage with partition size N only starts at tap 2N or later: its input block is complete
+N samples after it started, and its first output is due N samples after that, so a
+background thread always has a full partition period to compute it. The calling thread
+only waits if a stage misses that deadline.
+"""
+
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+
+from signal_processing import fft
+
+
+class _UniformStage:
+    """
+    Uniformly partitioned overlap-save for one segment of the impulse response.
+
+    Each call to ``compute`` takes the next ``size`` input samples and returns the next
+    ``size`` samples of the input convolved with the segment (without its start offset).
+    """
+
+    def __init__(self, segment, size, start):
+        self.size = size
+        self.start = start
+        count = int(np.ceil(segment.size / size))
+        padded = np.zeros(count * size)
+        padded[:segment.size] = segment
+        self.plan = fft.get_real_plan(2 * size)
+        self.spectra = self.plan.forward(padded.reshape(count, size))
+        # The delay line is stored twice over so the newest ``count`` spectra are always
+        # one contiguous slice, whatever the ring position.
+        self.delay_line = np.zeros((2 * count, size + 1), dtype=np.complex128)
+        self.window = np.zeros(2 * size)
+        self.spectrum = np.empty(size + 1, dtype=np.complex128)
+        self.result = np.empty(2 * size)
+        self.head = 0
+
+    @property
+    def count(self):
+        return self.spectra.shape[0]
+
+    def reset(self):
+        self.delay_line[:] = 0.0
+        self.window[:] = 0.0
+        self.head = 0
+
+    def compute(self, block):
+        """Return a view of the next ``size`` output samples, valid until the next call."""
+        size, count = self.size, self.count
+        self.window[:size] = self.window[size:]
+        self.window[size:] = block
+        # Slot ``head`` (and its mirror) holds the newest input spectrum
+        self.head = (self.head - 1) % count
+        self.plan.forward(self.window, out=self.delay_line[self.head])
+        self.delay_line[self.head + count] = self.delay_line[self.head]
+        np.einsum("pf,pf->f", self.delay_line[self.head:self.head + count], self.spectra,
+                  out=self.spectrum)
+        return self.plan.inverse(self.spectrum, out=self.result)[size:]
+
+
+class _BackgroundStage:
+    """A ``_UniformStage`` whose blocks are computed asynchronously and delivered late."""
+
+    def __init__(self, stage, block_size, executor):
+        self.stage = stage
+        self.block_size = block_size
+        self.executor = executor
+        # Two input buffers: one being filled while the worker reads the other
+        self.collected = np.zeros((2, stage.size))
+        self.current = 0
+        self.filled = 0
+        # Absolute sample index of the next input sample and ring of delivered output
+        self.time = 0
+        self.ring = np.zeros(stage.start + 2 * stage.size)
+        self.pending = []
+
+    def reset(self):
+        for _, future in self.pending:
+            future.result()
+        self.pending = []
+        self.stage.reset()
+        self.collected[:] = 0.0
+        self.filled = 0
+        self.time = 0
+        self.ring[:] = 0.0
+
+    def _compute(self, block):
+        # Runs on the worker; the copy keeps the result alive until it is delivered
+        return self.stage.compute(block).copy()
+
+    def _deliver(self, due, future):
+        result = future.result()
+        positions = (due + np.arange(result.size)) % self.ring.size
+        self.ring[positions] += result
+
+    def process(self, block, output):
+        """Feed one host block and add this stage's contribution to ``output``."""
+        size = self.stage.size
+        self.collected[self.current, self.filled:self.filled + block.size] = block
+        self.filled += block.size
+        block_end = self.time + block.size
+
+        # Outputs overlapping this host block must be in the ring before it is read
+        while self.pending and self.pending[0][0] < block_end:
+            self._deliver(*self.pending.pop(0))
+        positions = np.arange(self.time, block_end) % self.ring.size
+        output += self.ring[positions]
+        self.ring[positions] = 0.0
+
+        if self.filled == size:
+            # Stage state is updated by the task, so tasks of one stage must not overlap
+            if self.pending:
+                self.pending[-1][1].result()
+            block_start = block_end - size
+            future = self.executor.submit(self._compute, self.collected[self.current])
+            self.pending.append((block_start + self.stage.start, future))
+            self.current = 1 - self.current
+            self.filled = 0
+        self.time = block_end
+
+
+class _InlineExecutor:
+    """Executor stand-in that runs tasks immediately on the calling thread."""
+
+    def submit(self, function, *args):
+        return _CompletedFuture(function(*args))
+
+
+class _CompletedFuture:
+    def __init__(self, value):
+        self.value = value
+
+    def result(self):
+        return self.value
+
+
+class PartitionedConvolver:
+    """
+    Zero-latency non-uniform partitioned convolution of a mono signal.
+
+    Parameters
+    ----------
+    impulse_response : array_like
+        Filter taps.
+    block_size : int, optional
+        Host block size; every call to ``process`` must pass exactly this many samples.
+    uniform_partitions : int, optional
+        Minimum number of one-block partitions after the head.
+    max_partition_size : int, optional
+        Partitions stop growing at this size (rounded to a power-of-two multiple of the
+        block size); the remainder of the response uses uniform partitions of that size.
+    num_threads : int, optional
+        Background workers. Zero computes every stage on the calling thread (useful for
+        offline rendering). Defaults to one per growing stage.
+    """
+
+    def __init__(self, impulse_response, block_size=64, uniform_partitions=3,
+                 max_partition_size=16384, num_threads=None):
+        taps = np.asarray(impulse_response, dtype=np.float64)
+        self.block_size = int(block_size)
+        size = self.block_size
+        self.head = taps[:size]
+        self.head_tail = np.zeros(size - 1)
+
+        self.partitions = []
+        layout = self._layout(taps.size, uniform_partitions, max_partition_size)
+        background = [entry for entry in layout if entry[0] > size]
+        if num_threads is None:
+            num_threads = len(background)
+        self.executor = ThreadPoolExecutor(num_threads) if num_threads > 0 and background else None
+
+        self.uniform = None
+        self.previous_block = np.zeros(size)
+        self.background = []
+        for partition, start, count in layout:
+            stage = _UniformStage(taps[start:start + partition * count], partition, start)
+            self.partitions.append((start, partition, stage.count))
+            if partition == size:
+                self.uniform = stage
+            else:
+                executor = self.executor if self.executor is not None else _InlineExecutor()
+                self.background.append(_BackgroundStage(stage, size, executor))
+
+    def _layout(self, length, uniform_partitions, max_partition_size):
+        """List of (partition size, start tap, partition count) covering taps block_size..length."""
+        size = self.block_size
+        largest = size
+        while largest * 2 <= max(max_partition_size, size):
+            largest *= 2
+        layout = []
+        start, partition = size, size
+        while start < length:
+            remaining = int(np.ceil((length - start) / partition))
+            if partition == largest:
+                count = remaining
+            else:
+                # Stay at this size until the next size may start (at twice its length)
+                count = max(int(np.ceil((4 * partition - start) / partition)), 1)
+                if partition == size:
+                    count = max(count, int(uniform_partitions))
+                count = min(count, remaining)
+            layout.append((partition, start, count))
+            start += partition * count
+            if partition < largest:
+                partition *= 2
+        return layout
+
+    @property
+    def latency(self):
+        """Input-to-output latency in samples (always zero)."""
+        return 0
+
+    def reset(self):
+        """Clear all filter state."""
+        self.head_tail[:] = 0.0
+        self.previous_block[:] = 0.0
+        if self.uniform is not None:
+            self.uniform.reset()
+        for stage in self.background:
+            stage.reset()
+
+    def close(self):
+        """
+        Stop the background workers. Tasks already submitted finish first; later blocks
+        are computed on the calling thread, as with ``num_threads=0``.
+        """
+        if self.executor is not None:
+            self.executor.shutdown(wait=True)
+            self.executor = None
+            for stage in self.background:
+                stage.executor = _InlineExecutor()
+
+    def process(self, block):
+        """
+        Convolve one block of input.
+
+        Parameters
+        ----------
+        block : array_like
+            Exactly ``block_size`` input samples.
+
+        Returns
+        -------
+        numpy.ndarray
+            The corresponding ``block_size`` output samples.
+        """
+        block = np.asarray(block, dtype=np.float64)
+        size = self.block_size
+        if block.size != size:
+            raise ValueError(f"Expected a block of {size} samples, got {block.size}")
+
+        direct = np.convolve(block, self.head)
+        output = direct[:size].copy()
+        output[:size - 1] += self.head_tail
+        self.head_tail[:] = 0.0
+        self.head_tail[:direct.size - size] = direct[size:]
+
+        # The uniform stage starts one block after the head, so it is fed the previous
+        # block; its delay line supplies the older ones.
+        if self.uniform is not None:
+            output += self.uniform.compute(self.previous_block)
+            self.previous_block[:] = block
+        for stage in self.background:
+            stage.process(block, output)
+        return output
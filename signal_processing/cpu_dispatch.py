@@ -0,0 +1,215 @@
+"""
+CPU feature detection and selection of per-ISA kernel variants.
+
+The arithmetic of the hot kernels already runs on code chosen at run time from the
+host's CPUID: NumPy compiles its ufuncs (the stencil updates, delay lines and state
+recurrences) for several instruction set levels and dispatches on import, and OpenBLAS
+built with ``DYNAMIC_ARCH`` (the oscillator banks, block biquads and bridge solves are
+matrix products) picks its GEMM kernels per core type. What is left to Virbras are the
+choices whose best value depends on the vector width, such as the size of the dense DFT
+an FFT starts from: a wider unit makes the dense product cheaper relative to the
+butterfly stages that follow.
+
+Such choices are registered as ``Kernel`` variants per ISA level (``generic``, ``sse2``,
+``avx2`` for AVX2 with FMA, ``avx512`` for the x86-64-v4 set) and selected once, when the
+module defining them is imported, for the best level the host supports. The
+``VIRBRAS_ISA`` environment variable lowers the level for Virbras' own choices; to make
+NumPy and OpenBLAS follow as well, start the process with ``emulation_environment``,
+which is how a render farm node can check that every variant gives the same output.
+``report`` lists the detected features and every selection, for logging at startup.
+"""
+
+import os
+import platform
+
+import numpy as np
+
+ISA_LEVELS = ("generic", "sse2", "avx2", "avx512")
+
+# Features each level needs, named as in NumPy's CPUID table
+_REQUIRED = {
+    "sse2": ("SSE", "SSE2"),
+    "avx2": ("AVX", "AVX2", "FMA3"),
+    "avx512": ("AVX512F", "AVX512CD", "AVX512BW", "AVX512DQ", "AVX512VL"),
+}
+
+# The same features as named in /proc/cpuinfo
+_CPUINFO_FLAGS = {"SSE": "sse", "SSE2": "sse2", "AVX": "avx", "AVX2": "avx2", "FMA3": "fma",
+                  "AVX512F": "avx512f", "AVX512CD": "avx512cd", "AVX512BW": "avx512bw",
+                  "AVX512DQ": "avx512dq", "AVX512VL": "avx512vl"}
+
+# NumPy dispatch targets to disable and OpenBLAS core type that emulate each level
+_EMULATION = {
+    "avx512": ("", "SkylakeX"),
+    "avx2": ("X86_V4 AVX512_ICL AVX512_SPR", "Haswell"),
+    "sse2": ("X86_V3 X86_V4 AVX512_ICL AVX512_SPR", "Nehalem"),
+}
+
+_features = None
+
+
+def _umath():
+    # NumPy 2 moved the extension module from numpy.core to numpy._core
+    try:
+        from numpy._core import _multiarray_umath
+    except ImportError:
+        from numpy.core import _multiarray_umath
+    return _multiarray_umath
+
+
+def _numpy_features():
+    features = _umath().__cpu_features__
+    return {name for name, present in features.items() if present}
+
+
+def _cpuinfo_features():
+    try:
+        with open("/proc/cpuinfo") as handle:
+            for line in handle:
+                if line.startswith("flags"):
+                    flags = set(line.split(":", 1)[1].split())
+                    return {name for name, flag in _CPUINFO_FLAGS.items() if flag in flags}
+    except OSError:
+        pass
+    return set()
+
+
+def cpu_features():
+    """Names of the CPU features present, from NumPy's CPUID probe or /proc/cpuinfo."""
+    global _features
+    if _features is None:
+        try:
+            _features = frozenset(_numpy_features())
+        except (ImportError, AttributeError):
+            _features = frozenset(_cpuinfo_features())
+    return _features
+
+
+def host_level():
+    """Best ISA level the host supports."""
+    if platform.machine() not in ("x86_64", "AMD64"):
+        return "generic"
+    features = cpu_features()
+    best = "generic"
+    for level in ISA_LEVELS[1:]:
+        if not features.issuperset(_REQUIRED[level]):
+            break
+        best = level
+    return best
+
+
+def active_level():
+    """
+    Level the variants are selected for: the host's, or ``VIRBRAS_ISA`` if that is lower.
+
+    A requested level above the host's is ignored, since its variants might not run.
+    """
+    host = host_level()
+    requested = os.environ.get("VIRBRAS_ISA", "").strip().lower()
+    if not requested:
+        return host
+    if requested not in ISA_LEVELS:
+        raise ValueError(f"VIRBRAS_ISA must be one of {', '.join(ISA_LEVELS)}, got {requested!r}")
+    return min(requested, host, key=ISA_LEVELS.index)
+
+
+def emulation_environment(level, environment=None):
+    """
+    Environment for a subprocess whose NumPy, OpenBLAS and Virbras code all run at ``level``.
+
+    Parameters
+    ----------
+    level : str
+        One of ``ISA_LEVELS`` other than ``generic``.
+    environment : dict, optional
+        Environment to extend; defaults to a copy of ``os.environ``.
+    """
+    if level not in _EMULATION:
+        raise ValueError(f"Cannot emulate ISA level {level!r}")
+    disabled, core = _EMULATION[level]
+    environment = dict(os.environ if environment is None else environment)
+    environment["VIRBRAS_ISA"] = level
+    environment["OPENBLAS_CORETYPE"] = core
+    if disabled:
+        environment["NPY_DISABLE_CPU_FEATURES"] = disabled
+    else:
+        environment.pop("NPY_DISABLE_CPU_FEATURES", None)
+    return environment
+
+
+class Kernel:
+    """
+    Variants of one kernel (a function or a tuning value) per ISA level.
+
+    ``select`` returns the variant registered for the highest level not above the active
+    one; the choice is cached, so call it once at import time and keep the result.
+    """
+
+    def __init__(self, name):
+        self.name = name
+        self.variants = {}
+        self.selected = None
+
+    def register(self, level, variant):
+        """Add the variant for ``level`` and return it."""
+        if level not in ISA_LEVELS:
+            raise ValueError(f"Unknown ISA level {level!r}")
+        self.variants[level] = variant
+        self.selected = None
+        return variant
+
+    def select(self):
+        """The variant for the active level."""
+        if self.selected is None:
+            active = ISA_LEVELS.index(active_level())
+            levels = [level for level in self.variants if ISA_LEVELS.index(level) <= active]
+            if not levels:
+                raise ValueError(f"Kernel {self.name!r} has no variant for this CPU")
+            self.selected = max(levels, key=ISA_LEVELS.index)
+        return self.variants[self.selected]
+
+
+# name -> Kernel
+KERNELS = {}
+
+
+def kernel(name):
+    """The registered kernel called ``name``, created on first use."""
+    if name not in KERNELS:
+        KERNELS[name] = Kernel(name)
+    return KERNELS[name]
+
+
+def report():
+    """Detected features, the active level and the variant chosen for every kernel."""
+    umath = _umath()
+    baseline = getattr(umath, "__cpu_baseline__", [])
+    dispatch = getattr(umath, "__cpu_dispatch__", [])
+    features = cpu_features()
+    try:
+        config = np.show_config(mode="dicts")
+    except TypeError:
+        # Before NumPy 1.25 the build configuration is only printed
+        config = {}
+    blas = config.get("Build Dependencies", {}).get("blas", {})
+    return {
+        "host_level": host_level(),
+        "active_level": active_level(),
+        "features": sorted(features),
+        "numpy_baseline": list(baseline),
+        "numpy_dispatch": [target for target in dispatch if target in features],
+        "blas": blas.get("openblas configuration", blas.get("name", "")),
+        "openblas_coretype": os.environ.get("OPENBLAS_CORETYPE", ""),
+        "kernels": {name: kernel.selected for name, kernel in KERNELS.items()},
+    }
+
+
+if __name__ == "__main__":
+    import json
+
+    # Run as a script this is a second copy of the module; report from the one the
+    # kernel modules register with
+    import signal_processing.fft  # noqa: F401
+    from signal_processing import cpu_dispatch
+
+    print(json.dumps(cpu_dispatch.report(), indent=2))
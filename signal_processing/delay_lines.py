@@ -0,0 +1,323 @@
+"""
+Delay lines with fractional, modulated delays.
+
+All lines keep their history in a power-of-two ring buffer, so wrapping a read or write
+index is a bitwise and. ``FractionalDelayLine`` reads with an FIR interpolator (linear,
+Lagrange or windowed sinc): the integer and fractional parts of every read position in a
+block are computed at once, the interpolation weights for all of them in one vectorized
+call, and the output is one gather plus one batched dot product. Any number of taps can
+be read at arbitrary, per-sample delays, which is what moving pickups and multi-tap
+reverbs need.
+
+``process`` moves the delay linearly from its previous value to the new one across the
+block, so modulating the delay once per block produces no steps (and hence no clicks),
+while the weights are still only evaluated in bulk once per block.
+
+``ThiranDelayLine`` interpolates with a Thiran allpass instead, which has a flat
+magnitude response and is the usual choice for tuning waveguide loops. Being recursive,
+its coefficients are updated once per block rather than per sample.
+
+In a waveguide the output of a line is fed back into it and decays towards zero, so both
+lines flush subnormal samples to zero as they are written, and the allpass flushes its
+feedback state once per block.
+"""
+
+import numpy as np
+
+from signal_processing.denormals import flush_denormals
+from signal_processing.resampling import kaiser_sinc_table
+
+
+def _ring_size(length):
+    size = 1
+    while size < length:
+        size *= 2
+    return size
+
+
+class LinearInterpolator:
+    """Two-point linear interpolation."""
+
+    taps = 2
+    offset = 0
+
+    def weights(self, fractions):
+        fractions = fractions[..., None]
+        return np.concatenate([1.0 - fractions, fractions], axis=-1)
+
+
+class LagrangeInterpolator:
+    """
+    Lagrange interpolation of a given order, centred on the read position.
+
+    Odd orders (3 is the classic choice) have their taps placed symmetrically around the
+    interval that contains the read position.
+    """
+
+    def __init__(self, order=3):
+        self.order = int(order)
+        self.taps = self.order + 1
+        self.offset = -(self.order // 2)
+        nodes = np.arange(self.taps)
+        self._nodes = nodes
+        self._denominators = np.array([np.prod([j - k for k in nodes if k != j]) for j in nodes],
+                                      dtype=np.float64)
+
+    def weights(self, fractions):
+        # Read position measured from the first tap
+        x = fractions[..., None] - self.offset
+        differences = x - self._nodes
+        weights = np.empty(fractions.shape + (self.taps,))
+        for j in range(self.taps):
+            others = np.delete(differences, j, axis=-1)
+            weights[..., j] = np.prod(others, axis=-1) / self._denominators[j]
+        return weights
+
+
+class SincInterpolator:
+    """Kaiser-windowed sinc interpolation over ``2 * zero_crossings`` taps."""
+
+    def __init__(self, zero_crossings=8, resolution=256, beta=8.0):
+        self.zero_crossings = int(zero_crossings)
+        self.resolution = int(resolution)
+        self.taps = 2 * self.zero_crossings
+        self.offset = -self.zero_crossings + 1
+        self.table, self.slopes = kaiser_sinc_table(self.zero_crossings, self.resolution, beta)
+        self._nodes = np.arange(self.taps) + self.offset
+
+    def weights(self, fractions):
+        position = np.abs(self._nodes - fractions[..., None]) * self.resolution
+        index = np.minimum(position.astype(np.intp), self.table.size - 1)
+        return self.table[index] + (position - index) * self.slopes[index]
+
+
+class FractionalDelayLine:
+    """
+    Ring-buffer delay line read through an FIR interpolator.
+
+    Parameters
+    ----------
+    max_delay : float
+        Longest delay that will be read, in samples.
+    max_block_size : int
+        Largest block passed to ``write`` or ``process``.
+    interpolator : object, optional
+        ``LinearInterpolator``, ``LagrangeInterpolator`` or ``SincInterpolator`` (or any
+        object with ``taps``, ``offset`` and ``weights(fractions)``). Defaults to
+        third-order Lagrange.
+    delay : float, optional
+        Initial delay used by ``process``.
+    """
+
+    def __init__(self, max_delay, max_block_size, interpolator=None, delay=None):
+        self.interpolator = LagrangeInterpolator() if interpolator is None else interpolator
+        self.max_delay = float(max_delay)
+        self.max_block_size = int(max_block_size)
+        size = _ring_size(int(np.ceil(self.max_delay)) + self.interpolator.taps
+                          + self.max_block_size + 1)
+        self.buffer = np.zeros(size)
+        self.mask = size - 1
+        self.output = np.zeros(self.max_block_size)
+        self.delay = self.min_delay if delay is None else float(delay)
+        self.reset()
+
+    @property
+    def min_delay(self):
+        """Shortest delay whose taps are all already written."""
+        return float(self.interpolator.offset + self.interpolator.taps - 1)
+
+    def reset(self):
+        """Clear the history."""
+        self.buffer[:] = 0.0
+        # Ring index one past the newest sample, and the length of the last written block
+        self.head = 0
+        self.written = 0
+
+    def write(self, block):
+        """Append a block of input samples."""
+        block = np.asarray(block, dtype=np.float64)
+        count = block.size
+        if count > self.max_block_size:
+            raise ValueError(f"Block of {count} samples exceeds max_block_size")
+        first = min(count, self.buffer.size - self.head)
+        self.buffer[self.head:self.head + first] = block[:first]
+        self.buffer[:count - first] = block[first:]
+        flush_denormals(self.buffer[self.head:self.head + first])
+        flush_denormals(self.buffer[:count - first])
+        self.head = (self.head + count) & self.mask
+        self.written = count
+
+    def read(self, delays, out=None):
+        """
+        Read the last written block through delays in samples.
+
+        Parameters
+        ----------
+        delays : array_like
+            Delay of every output sample, shape (..., block) for the block written last
+            (a scalar or shorter shape broadcasts), clipped to [min_delay, max_delay].
+            Leading axes read several taps at once.
+        out : numpy.ndarray, optional
+            Destination of the same shape.
+
+        Returns
+        -------
+        numpy.ndarray
+            Delayed samples: sample n of the block is read ``delays[..., n]`` samples
+            before input sample n.
+        """
+        count = self.written
+        delays = np.clip(np.asarray(delays, dtype=np.float64), self.min_delay, self.max_delay)
+        delays = np.broadcast_to(delays, delays.shape[:-1] + (count,) if delays.ndim else (count,))
+        # Read positions relative to the first sample of the last block; the integer part
+        # stays small, so fractions keep full precision however long the line has run.
+        positions = np.arange(count) - delays
+        bases = np.floor(positions)
+        fractions = positions - bases
+        start = self.head - count + self.interpolator.offset
+        index = (bases.astype(np.intp)[..., None] + start + np.arange(self.interpolator.taps))
+        weights = self.interpolator.weights(fractions)
+        if out is None:
+            out = np.empty(delays.shape)
+        np.einsum("...t,...t->...", self.buffer[index & self.mask], weights, out=out)
+        return out
+
+    def process(self, block, delay=None):
+        """
+        Write a block and read it back with a delay that glides from the previous one.
+
+        Parameters
+        ----------
+        block : array_like
+            Input samples.
+        delay : float, optional
+            Delay to reach at the last sample of the block; defaults to the current delay.
+
+        Returns
+        -------
+        numpy.ndarray
+            Delayed block (a view into an internal buffer).
+        """
+        self.write(block)
+        count = self.written
+        target = self.delay if delay is None else float(delay)
+        ramp = np.arange(1, count + 1) / max(count, 1)
+        delays = self.delay + (target - self.delay) * ramp
+        self.delay = target
+        return self.read(delays, out=self.output[:count])
+
+
+def thiran_coefficients(delay, order):
+    """
+    Denominator a_0 .. a_N (a_0 = 1) of the order-N Thiran allpass with the given delay.
+
+    The allpass is H(z) = z^-N A(1 / z) / A(z); it is stable for delays above N - 1 and
+    most accurate for delays near N.
+    """
+    k = np.arange(1, order + 1)
+    n = np.arange(order + 1)
+    binomial = np.array([np.prod(np.arange(order - j + 1, order + 1)) / np.prod(np.arange(1, j + 1))
+                         for j in k])
+    # a_0 = 1 is taken out of the product, which is 0 / 0 at integer delays
+    ratios = np.prod((delay - order + n[None, :]) / (delay - order + k[:, None] + n[None, :]),
+                     axis=1)
+    return np.concatenate(([1.0], (-1.0)**k * binomial * ratios))
+
+
+class ThiranDelayLine:
+    """
+    Ring-buffer delay line with Thiran allpass fractional interpolation.
+
+    The delay is split into an integer part read from the ring and an allpass delay in
+    [order - 0.5, order + 0.5). ``process`` glides the delay across the block like
+    ``FractionalDelayLine``, but the coefficients are only recomputed every
+    ``update_interval`` samples, at the delay reached by the end of that stretch. The
+    integer-delayed input is re-read from the ring for every stretch, so a change of the
+    integer part keeps the allpass input history consistent; only the feedback state
+    carries over. Fast, deep modulation still leaves small allpass transients, so the FIR
+    lines are the better choice for chorus-like effects.
+
+    Parameters
+    ----------
+    max_delay : float
+        Longest delay, in samples.
+    max_block_size : int
+        Largest block passed to ``process``.
+    order : int, optional
+        Allpass order.
+    delay : float, optional
+        Initial delay.
+    update_interval : int, optional
+        Samples between coefficient updates while the delay is moving.
+    """
+
+    def __init__(self, max_delay, max_block_size, order=1, delay=None, update_interval=16):
+        self.order = int(order)
+        self.max_delay = float(max_delay)
+        self.max_block_size = int(max_block_size)
+        self.update_interval = int(update_interval)
+        size = _ring_size(int(np.ceil(self.max_delay)) + self.order + self.max_block_size + 1)
+        self.buffer = np.zeros(size)
+        self.mask = size - 1
+        self.output = np.zeros(self.max_block_size)
+        self.delay = self.min_delay if delay is None else float(delay)
+        self.reset()
+
+    @property
+    def min_delay(self):
+        return self.order - 0.5
+
+    def reset(self):
+        self.buffer[:] = 0.0
+        self.head = 0
+        self.feedback = np.zeros(self.order)
+
+    def _filter(self, output, start, stop, delay):
+        """Run the allpass for samples start..stop of the block that ends at the ring head."""
+        order = self.order
+        integer = int(np.floor(delay - order + 0.5))
+        a = thiran_coefficients(delay - integer, order)
+        # Integer-delayed input, including the ``order`` samples before the stretch
+        first = self.head - output.size + start - integer - order
+        index = (first + np.arange(stop - start + order)) & self.mask
+        x = self.buffer[index].tolist()
+        numerator = a[::-1].tolist()
+        denominator = a[1:].tolist()
+        y = self.feedback.tolist()
+        for n in range(stop - start):
+            value = 0.0
+            for k in range(order + 1):
+                value += numerator[k] * x[n + order - k]
+            for k in range(order):
+                value -= denominator[k] * y[-1 - k]
+            y.append(value)
+            output[start + n] = value
+        self.feedback[:] = y[-order:]
+
+    def process(self, block, delay=None):
+        """
+        Write a block and read it back with a delay that glides from the previous one.
+
+        Returns the delayed block (a view into an internal buffer).
+        """
+        block = np.asarray(block, dtype=np.float64)
+        count = block.size
+        if count > self.max_block_size:
+            raise ValueError(f"Block of {count} samples exceeds max_block_size")
+        target = self.delay if delay is None else float(np.clip(delay, self.min_delay,
+                                                                 self.max_delay))
+        first = min(count, self.buffer.size - self.head)
+        self.buffer[self.head:self.head + first] = block[:first]
+        self.buffer[:count - first] = block[first:]
+        flush_denormals(self.buffer[self.head:self.head + first])
+        flush_denormals(self.buffer[:count - first])
+        self.head = (self.head + count) & self.mask
+        flush_denormals(self.feedback)
+
+        output = self.output[:count]
+        interval = count if target == self.delay else self.update_interval
+        for start in range(0, count, interval):
+            stop = min(start + interval, count)
+            self._filter(output, start, stop, self.delay + (target - self.delay) * stop / count)
+        self.delay = target
+        return output
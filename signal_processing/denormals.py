@@ -0,0 +1,118 @@
+"""
+Protection against subnormal (denormal) floating point numbers.
+
+Decaying oscillators and feedback filters approach zero exponentially, and once their
+states drop below 2.2e-308 every operation on them takes a slow microcode path on x86,
+often ten times slower or worse. Two defences are provided:
+
+* ``flush_to_zero`` sets the flush-to-zero and denormals-are-zero bits of the SSE control
+  register (MXCSR) for the calling thread while a render runs, and restores the previous
+  value afterwards. NumPy's kernels run on the calling thread, so they see the mode. It
+  is implemented with glibc's ``fegetenv``/``fesetenv`` on x86-64 Linux and does nothing
+  elsewhere (``FLUSH_TO_ZERO_SUPPORTED`` tells which).
+* ``flush_denormals`` zeroes tiny values of a state array in place by adding and
+  subtracting a small offset: anything below about 1e-46 rounds to exactly zero. The
+  absolute error is at most half a unit in the last place of the offset (about 9e-47)
+  for values below it, and half a unit in the last place of the value itself for
+  values near it, so it stays under 1e-43 up to 1e-27; values far above the offset come
+  back unchanged. The recursive kernels (oscillator banks, biquads, delay lines) apply
+  it to their state once per block, so they stay fast even in hosts that reset the
+  control register behind our back.
+"""
+
+import ctypes
+import ctypes.util
+import platform
+import sys
+
+import numpy as np
+
+# Added to and subtracted from states; values much smaller than it round to zero
+DENORMAL_OFFSET = 1e-30
+
+_FTZ_DAZ = 0x8040  # flush-to-zero (bit 15) and denormals-are-zero (bit 6)
+
+
+class _Environment(ctypes.Structure):
+    # glibc's fenv_t on x86-64: the x87 environment followed by MXCSR
+    _fields_ = [("x87", ctypes.c_uint16 * 14), ("mxcsr", ctypes.c_uint32)]
+
+
+def _load_libm():
+    if not (sys.platform.startswith("linux") and platform.machine() in ("x86_64", "AMD64")):
+        return None
+    name = ctypes.util.find_library("m")
+    try:
+        libm = ctypes.CDLL(name)
+        libm.fegetenv, libm.fesetenv
+    except (OSError, TypeError, AttributeError):
+        return None
+    return libm
+
+
+_libm = _load_libm()
+FLUSH_TO_ZERO_SUPPORTED = _libm is not None
+
+
+def _get_mxcsr():
+    environment = _Environment()
+    _libm.fegetenv(ctypes.byref(environment))
+    return environment
+
+
+def _write_bits(bits):
+    """Set the FTZ and DAZ bits of MXCSR to ``bits``; returns the bits they replaced."""
+    environment = _get_mxcsr()
+    previous = environment.mxcsr & _FTZ_DAZ
+    if previous != bits:
+        environment.mxcsr = (environment.mxcsr & ~_FTZ_DAZ & 0xFFFFFFFF) | bits
+        _libm.fesetenv(ctypes.byref(environment))
+    return previous
+
+
+def set_flush_to_zero(enabled=True):
+    """
+    Switch flush-to-zero and denormals-are-zero on or off for the calling thread.
+
+    Returns the previous FTZ and DAZ bits of the control register, to be handed to
+    ``restore_flush_to_zero``, or None where the mode cannot be set. Meant for threads
+    that only ever render (pool workers); elsewhere use the ``flush_to_zero`` scope.
+    """
+    if _libm is None:
+        return None
+    return _write_bits(_FTZ_DAZ if enabled else 0)
+
+
+def restore_flush_to_zero(bits):
+    """Put back the bits returned by ``set_flush_to_zero``, each of the two as it was."""
+    if _libm is not None and bits is not None:
+        _write_bits(bits & _FTZ_DAZ)
+
+
+class flush_to_zero:
+    """
+    Scope in which the calling thread flushes subnormal results and inputs to zero.
+
+    Scopes nest; leaving one restores the control bits found when it was entered.
+    """
+
+    def __enter__(self):
+        self._previous = set_flush_to_zero(True)
+        return self
+
+    def __exit__(self, kind, error, traceback):
+        restore_flush_to_zero(self._previous)
+        return False
+
+
+def flush_denormals(state, offset=DENORMAL_OFFSET):
+    """
+    Zero the subnormal and nearly subnormal entries of a float or complex array in place.
+
+    Returns the array.
+    """
+    if np.iscomplexobj(state):
+        offset = complex(offset, offset)
+    np.add(state, offset, out=state)
+    np.subtract(state, offset, out=state)
+    return state
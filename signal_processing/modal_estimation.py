@@ -0,0 +1,238 @@
+"""
+Estimation of modal frequencies, decays and amplitudes from recorded notes.
+
+A recording is split into uniform frequency bands by a decimated filter bank: frames
+taken every D samples are windowed with a lowpass prototype and demodulated by every
+band centre in one matrix product, which gives each band as a complex signal at 1 / D
+of the sample rate (the STFT at those centres with hop D). A damped sinusoid
+
+    A exp(-sigma t) sin(omega t + phi)
+
+shows up in its band as a complex exponential with pole z = exp((i omega - sigma) D / fs),
+so the modes of a band can be found with ESPRIT: the shift invariance of the signal
+subspace of the band's Hankel matrix gives the poles directly, and a least-squares fit
+of the resulting Vandermonde matrix gives the complex amplitudes. Because each band only
+holds a handful of modes and is heavily decimated, the subspace problems are small, and
+the bands are independent, so they are solved in parallel.
+
+``estimate_recordings`` runs whole notes in a process pool (one note per task) for
+calibrating sampled instruments, and ``ModalEstimate.to_oscillator_bank`` turns a result
+into a ``HarmonicOscillatorBank`` that resynthesizes it.
+"""
+
+from concurrent.futures import ProcessPoolExecutor, ThreadPoolExecutor
+from dataclasses import dataclass
+from functools import partial
+
+import numpy as np
+from numpy.lib.stride_tricks import sliding_window_view
+
+from physics.one_dimensional.harmonic_oscillators import HarmonicOscillatorBank
+
+
+@dataclass
+class ModalEstimate:
+    """
+    Modes of one recording, sorted by frequency.
+
+    Attributes
+    ----------
+    frequencies : numpy.ndarray
+        Damped frequencies in Hz.
+    decay_rates : numpy.ndarray
+        Amplitude decay rates sigma in 1/s.
+    amplitudes : numpy.ndarray
+        Amplitudes A at the analysis start.
+    phases : numpy.ndarray
+        Phases phi in rad of A exp(-sigma t) sin(omega t + phi) at the analysis start.
+    start : int
+        Sample index of the recording at which t = 0.
+    """
+
+    frequencies: np.ndarray
+    decay_rates: np.ndarray
+    amplitudes: np.ndarray
+    phases: np.ndarray
+    start: int = 0
+
+    @property
+    def num_modes(self):
+        return self.frequencies.size
+
+    def to_oscillator_bank(self, sample_rate, block_size=64):
+        """
+        Oscillator bank whose response to a unit impulse has the estimated envelopes.
+
+        The impulse response has every mode in sine phase; assigning
+        ``initial_state(bank)`` to ``bank.state`` instead reproduces the recorded phases.
+        """
+        omega_d = 2.0 * np.pi * self.frequencies
+        undamped = np.sqrt(omega_d**2 + self.decay_rates**2) / (2.0 * np.pi)
+        # A unit impulse leaves Im(z) = e^{-sigma t} sin(omega_d t) dt / omega_d
+        gains = self.amplitudes * omega_d * sample_rate
+        return HarmonicOscillatorBank(undamped, self.decay_rates, sample_rate,
+                                      output_gains=gains, block_size=block_size)
+
+    def initial_state(self, bank):
+        """State of ``bank`` whose free response reproduces the recording from ``start``."""
+        # Bank output n is Im(g z p^(n + 1)); match A e^{i phi} p^n
+        return self.amplitudes * np.exp(1j * self.phases) / (bank.output_gains * bank.poles)
+
+
+def _prototype(length, cutoff, sample_rate, beta=6.0):
+    """Kaiser-windowed sinc lowpass with -6 dB point ``cutoff`` Hz and unit DC gain."""
+    n = np.arange(length) - (length - 1) / 2.0
+    taps = np.sinc(2.0 * cutoff / sample_rate * n) * np.kaiser(length, beta)
+    return taps / taps.sum()
+
+
+def _band_signals(signal, sample_rate, centres, band_width, max_frames):
+    """Decimated complex band signals (frames x bands), the prototype and the hop."""
+    hop = max(int(sample_rate / (2.0 * band_width)), 1)
+    # Flat to half the band width, down by about 60 dB from one band width off centre
+    length = int(np.ceil(8.0 * sample_rate / band_width))
+    window = _prototype(length, 0.75 * band_width, sample_rate)
+    frames = sliding_window_view(signal, length)[::hop][:max_frames]
+    if frames.shape[0] == 0:
+        raise ValueError("Recording is shorter than one analysis frame")
+    demodulation = window[:, None] * np.exp(
+        -2j * np.pi * np.arange(length)[:, None] * centres[None, :] / sample_rate)
+    return frames @ demodulation, window, hop
+
+
+def _esprit_poles(samples, max_modes, dynamic_range_db):
+    """Poles of a sum of damped complex exponentials (ESPRIT on the Hankel matrix)."""
+    count = samples.size
+    # Rows of the Hankel matrix are shifted windows s[i:i + columns]; a few times the model
+    # order is enough columns, and the many rows average out the noise.
+    columns = max(min(count // 3, 8 * max_modes), 2)
+    hankel = sliding_window_view(samples, columns)
+    _, singular, vh = np.linalg.svd(hankel, full_matrices=False)
+    if singular[0] == 0.0:
+        return np.zeros(0, dtype=np.complex128)
+    threshold = singular[0] * 10.0**(-dynamic_range_db / 20.0)
+    order = int(min(np.count_nonzero(singular > threshold), max_modes, columns - 1))
+    # The row space is spanned by (1, z, z^2, ...) for every pole z
+    subspace = vh[:order].T
+    rotation = np.linalg.lstsq(subspace[:-1], subspace[1:], rcond=None)[0]
+    return np.linalg.eigvals(rotation)
+
+
+def _analyse_band(samples, centre, band_width, window, hop, sample_rate, max_modes,
+                  dynamic_range_db):
+    """Modes of one band as rows (frequency, decay rate, amplitude, phase)."""
+    poles = _esprit_poles(samples, max_modes, dynamic_range_db)
+    # Only decaying modes are physical
+    poles = poles[(np.abs(poles) > 0.0) & (np.abs(poles) < 1.0)]
+    if poles.size == 0:
+        return np.zeros((4, 0))
+    vandermonde = poles[None, :] ** np.arange(samples.size)[:, None]
+    weights = np.linalg.lstsq(vandermonde, samples, rcond=None)[0]
+    # Resolve the frequency ambiguity of the decimated pole with the band centre
+    step = 2.0 * np.pi * centre * hop / sample_rate
+    offset = np.angle(poles * np.exp(-1j * step))
+    frequencies = centre + offset * sample_rate / (2.0 * np.pi * hop)
+    decay_rates = -np.log(np.abs(poles)) * sample_rate / hop
+    # Undo the prototype's gain and phase at each mode's own frequency and decay
+    j = np.arange(window.size)[:, None]
+    response = window @ np.exp((2j * np.pi * (frequencies - centre) - decay_rates)
+                               * j / sample_rate)
+    analytic = weights / response
+    keep = np.abs(frequencies - centre) <= 0.5 * band_width
+    result = np.stack([frequencies, decay_rates, 2.0 * np.abs(analytic),
+                       np.angle(analytic) + 0.5 * np.pi])
+    return result[:, keep]
+
+
+def estimate_modes(signal, sample_rate, band_width=400.0, max_frequency=None, start=None,
+                   max_frames=768, max_modes_per_band=12, dynamic_range_db=60.0,
+                   min_amplitude_db=-80.0, num_threads=None):
+    """
+    Estimate the modes of one recorded note.
+
+    Parameters
+    ----------
+    signal : array_like
+        Mono recording.
+    sample_rate : float
+        Sample rate in Hz.
+    band_width : float, optional
+        Width in Hz of the analysis bands. Each band should hold no more modes than
+        ``max_modes_per_band``.
+    max_frequency : float, optional
+        Highest frequency analysed; defaults to 0.45 of the sample rate.
+    start : int, optional
+        Sample at which the analysis starts (t = 0 of the estimate); defaults to the
+        peak of the recording, skipping the attack.
+    max_frames : int, optional
+        Number of decimated samples analysed per band, taken every
+        sample_rate / (2 band_width) input samples (about one second at the defaults).
+    max_modes_per_band : int, optional
+        Upper bound on the model order of a band.
+    dynamic_range_db : float, optional
+        Singular values further than this below the largest are treated as noise.
+    min_amplitude_db : float, optional
+        Modes weaker than this relative to the strongest are discarded.
+    num_threads : int, optional
+        Threads solving bands in parallel (the linear algebra releases the GIL). Zero
+        solves them on the calling thread; defaults to the executor's choice.
+
+    Returns
+    -------
+    ModalEstimate
+        Estimated modes sorted by frequency.
+    """
+    signal = np.asarray(signal, dtype=np.float64)
+    if start is None:
+        start = int(np.argmax(np.abs(signal)))
+    max_frequency = 0.45 * sample_rate if max_frequency is None else float(max_frequency)
+    centres = (np.arange(int(np.ceil(max_frequency / band_width))) + 0.5) * band_width
+    bands, window, hop = _band_signals(signal[start:], sample_rate, centres, band_width,
+                                       max_frames)
+
+    task = partial(_analyse_band, band_width=band_width, window=window, hop=hop,
+                   sample_rate=sample_rate, max_modes=max_modes_per_band,
+                   dynamic_range_db=dynamic_range_db)
+    if num_threads == 0:
+        results = list(map(task, bands.T, centres))
+    else:
+        with ThreadPoolExecutor(num_threads) as executor:
+            results = list(executor.map(task, bands.T, centres))
+
+    modes = np.concatenate(results, axis=1)
+    modes = modes[:, (modes[0] > 0.0) & (modes[0] < max_frequency)]
+    if modes.shape[1]:
+        floor = modes[2].max() * 10.0**(min_amplitude_db / 20.0)
+        modes = modes[:, modes[2] >= floor]
+    modes = modes[:, np.argsort(modes[0])]
+    phases = np.angle(np.exp(1j * modes[3]))
+    return ModalEstimate(modes[0], modes[1], modes[2], phases, start)
+
+
+def estimate_recordings(recordings, sample_rate, num_processes=None, **options):
+    """
+    Estimate the modes of many recordings in parallel, one process per recording at a time.
+
+    Parameters
+    ----------
+    recordings : sequence of array_like
+        Mono recordings (e.g. every note of a sampled instrument).
+    sample_rate : float
+        Sample rate in Hz, shared by all recordings.
+    num_processes : int, optional
+        Worker processes; defaults to the number of CPUs. Zero runs on the calling process.
+    **options
+        Passed to ``estimate_modes``. Bands are solved on the worker's own thread unless
+        ``num_threads`` is given, so the processes do not oversubscribe the CPUs.
+
+    Returns
+    -------
+    list of ModalEstimate
+        One estimate per recording, in order.
+    """
+    options.setdefault("num_threads", 0)
+    task = partial(estimate_modes, sample_rate=sample_rate, **options)
+    if num_processes == 0:
+        return [task(recording) for recording in recordings]
+    with ProcessPoolExecutor(num_processes) as executor:
+        return list(executor.map(task, recordings))
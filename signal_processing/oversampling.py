@@ -0,0 +1,216 @@
+"""
+Polyphase up- and down-sampling by 2, 4 or 8 for running nonlinear models oversampled.
+
+Both stages use one Kaiser-windowed sinc lowpass split into ``factor`` phases, so an
+upsampler does ``taps_per_phase`` multiply-adds per output sample and a decimator only
+computes the samples it keeps. The filter can be linear phase (constant delay, best for
+parallel dry/wet paths) or minimum phase (the same magnitude response with most of the
+delay removed, best for exciters inside a feedback loop).
+
+Work buffers are allocated for a maximum block size at construction; ``process`` then
+filters with sliding-window views and matrix products written into those buffers, so
+the audio path does not allocate. Results are views of internal buffers that stay valid
+until the next call.
+"""
+
+import numpy as np
+from numpy.lib.stride_tricks import sliding_window_view
+
+from signal_processing import fft
+
+_SUPPORTED_FACTORS = (2, 4, 8)
+
+
+def _minimum_phase(taps):
+    """Minimum-phase filter with the magnitude response of ``taps`` (homomorphic method)."""
+    size = 1
+    while size < 16 * taps.size:
+        size *= 2
+    magnitude = np.abs(fft.rfft(taps, size))
+    cepstrum = fft.irfft(np.log(np.maximum(magnitude, 1e-12)).astype(np.complex128), size)
+    # Fold the anti-causal part of the real cepstrum onto the causal part
+    folded = np.zeros(size)
+    folded[0] = cepstrum[0]
+    folded[1:size // 2] = 2.0 * cepstrum[1:size // 2]
+    folded[size // 2] = cepstrum[size // 2]
+    return fft.irfft(np.exp(fft.rfft(folded)), size)[:taps.size]
+
+
+def design_lowpass(factor, taps_per_phase=16, cutoff=0.9, beta=8.0, phase="linear"):
+    """
+    Anti-imaging / anti-aliasing lowpass for an oversampling factor.
+
+    Parameters
+    ----------
+    factor : int
+        Oversampling factor (2, 4 or 8).
+    taps_per_phase : int, optional
+        Filter length divided by the factor.
+    cutoff : float, optional
+        -6 dB point as a fraction of the host Nyquist frequency.
+    beta : float, optional
+        Kaiser window parameter; larger values trade transition width for stopband depth.
+    phase : {"linear", "minimum"}, optional
+        Phase response of the filter.
+
+    Returns
+    -------
+    numpy.ndarray
+        ``factor * taps_per_phase`` taps with unit DC gain.
+    """
+    if factor not in _SUPPORTED_FACTORS:
+        raise ValueError(f"Oversampling factor must be one of {_SUPPORTED_FACTORS}, got {factor}")
+    length = factor * int(taps_per_phase)
+    centre = (length - 1) / 2.0
+    frequency = 0.5 * cutoff / factor
+    n = np.arange(length) - centre
+    taps = 2.0 * frequency * np.sinc(2.0 * frequency * n) * np.kaiser(length, beta)
+    taps /= taps.sum()
+    if phase == "minimum":
+        taps = _minimum_phase(taps)
+        taps /= taps.sum()
+    elif phase != "linear":
+        raise ValueError(f"Unknown phase option {phase!r}")
+    return taps
+
+
+def _group_delay(taps):
+    """Delay at DC in samples of the filter's own rate."""
+    return float(np.dot(np.arange(taps.size), taps) / taps.sum())
+
+
+class Upsampler:
+    """
+    Polyphase interpolator.
+
+    Parameters
+    ----------
+    factor : int
+        Oversampling factor (2, 4 or 8).
+    max_block_size : int
+        Largest input block passed to ``process``.
+    taps_per_phase, cutoff, beta, phase
+        Filter design options, see ``design_lowpass``.
+    """
+
+    def __init__(self, factor, max_block_size, taps_per_phase=16, cutoff=0.9, beta=8.0,
+                 phase="linear"):
+        self.factor = int(factor)
+        self.max_block_size = int(max_block_size)
+        self.taps = design_lowpass(self.factor, taps_per_phase, cutoff, beta, phase)
+        self.taps_per_phase = int(taps_per_phase)
+        # Output phase p uses taps p, p + L, p + 2L, ...; the matrix is laid out against
+        # input windows that are oldest first, hence the reversed rows.
+        self.phases = np.ascontiguousarray(
+            self.factor * self.taps.reshape(self.taps_per_phase, self.factor)[::-1])
+        self.history = self.taps_per_phase - 1
+        self.buffer = np.zeros(self.history + self.max_block_size)
+        self.output = np.zeros(self.max_block_size * self.factor)
+
+    @property
+    def latency(self):
+        """Delay of the filter at DC, in oversampled samples."""
+        return _group_delay(self.taps)
+
+    def reset(self):
+        self.buffer[:] = 0.0
+
+    def process(self, block):
+        """Return ``factor * len(block)`` oversampled samples (a view into an internal buffer)."""
+        count = len(block)
+        if count > self.max_block_size:
+            raise ValueError(f"Block of {count} samples exceeds max_block_size")
+        end = self.history + count
+        self.buffer[self.history:end] = block
+        windows = sliding_window_view(self.buffer[:end], self.taps_per_phase)
+        output = self.output[:count * self.factor].reshape(count, self.factor)
+        np.matmul(windows, self.phases, out=output)
+        self.buffer[:self.history] = self.buffer[count:end]
+        return self.output[:count * self.factor]
+
+
+class Downsampler:
+    """
+    Polyphase decimator.
+
+    Parameters
+    ----------
+    factor : int
+        Oversampling factor (2, 4 or 8).
+    max_block_size : int
+        Largest output block; inputs hold ``factor`` times as many samples.
+    taps_per_phase, cutoff, beta, phase
+        Filter design options, see ``design_lowpass``.
+    """
+
+    def __init__(self, factor, max_block_size, taps_per_phase=16, cutoff=0.9, beta=8.0,
+                 phase="linear"):
+        self.factor = int(factor)
+        self.max_block_size = int(max_block_size)
+        self.taps = design_lowpass(self.factor, taps_per_phase, cutoff, beta, phase)
+        self.reversed_taps = np.ascontiguousarray(self.taps[::-1])
+        self.history = self.taps.size - 1
+        self.buffer = np.zeros(self.history + self.max_block_size * self.factor)
+        self.output = np.zeros(self.max_block_size)
+
+    @property
+    def latency(self):
+        """Delay of the filter at DC, in oversampled samples."""
+        return _group_delay(self.taps)
+
+    def reset(self):
+        self.buffer[:] = 0.0
+
+    def process(self, block):
+        """Return ``len(block) / factor`` samples (a view into an internal buffer)."""
+        length = len(block)
+        count = length // self.factor
+        if count * self.factor != length or count > self.max_block_size:
+            raise ValueError(f"Block of {length} samples is not a multiple of {self.factor} "
+                             f"no longer than {self.factor * self.max_block_size}")
+        end = self.history + length
+        self.buffer[self.history:end] = block
+        # Output m is the filtered input at sample m L, the first of its group
+        windows = sliding_window_view(self.buffer[:end], self.taps.size)[::self.factor]
+        np.matmul(windows, self.reversed_taps, out=self.output[:count])
+        self.buffer[:self.history] = self.buffer[length:end]
+        return self.output[:count]
+
+
+class Oversampler:
+    """
+    Runs a sample-rate dependent process at ``factor`` times the host rate.
+
+    Parameters
+    ----------
+    factor : int
+        Oversampling factor (2, 4 or 8).
+    max_block_size : int
+        Largest host block passed to ``process``.
+    taps_per_phase, cutoff, beta, phase
+        Filter design options shared by both stages, see ``design_lowpass``.
+    """
+
+    def __init__(self, factor, max_block_size, taps_per_phase=16, cutoff=0.9, beta=8.0,
+                 phase="linear"):
+        self.factor = int(factor)
+        self.up = Upsampler(factor, max_block_size, taps_per_phase, cutoff, beta, phase)
+        self.down = Downsampler(factor, max_block_size, taps_per_phase, cutoff, beta, phase)
+
+    @property
+    def latency(self):
+        """Round-trip delay at DC in host samples."""
+        return (self.up.latency + self.down.latency) / self.factor
+
+    def reset(self):
+        self.up.reset()
+        self.down.reset()
+
+    def process(self, block, function):
+        """
+        Upsample ``block``, apply ``function`` to the oversampled signal and decimate.
+
+        ``function`` receives the oversampled block and returns an array of the same length
+        (it may modify its argument in place and return it).
+        """
+        return self.down.process(function(self.up.process(block)))
@@ -0,0 +1,189 @@
+"""
+Streaming sample-rate conversion with arbitrary and time-varying ratios.
+
+Each output sample is a windowed-sinc interpolation of the input around its fractional
+input position. The kernel is tabulated once at ``table_resolution`` points per zero
+crossing and read with linear interpolation, so any fractional position (and any
+ratio) costs the same. For downsampling the kernel is stretched by the ratio to lower
+its cutoff; the number of taps is fixed by the lowest ratio allowed, so the work per
+output sample is constant and a block is computed as one gather plus one batched dot
+product over all of its output samples.
+
+The converter keeps its input history and fractional read position between calls, so
+a signal can be fed in blocks of any size and the ratio can glide from block to block
+without discontinuities.
+"""
+
+import numpy as np
+from numpy.lib.stride_tricks import sliding_window_view
+
+
+def kaiser_sinc_table(zero_crossings, resolution, beta):
+    """
+    Kaiser-windowed sinc kernel tabulated for linear interpolation.
+
+    Returns the kernel k(x) = sinc(x) w(x / Z) at x = i / resolution for x in [0, Z], with
+    trailing zeros so that reading just past the last point stays in range, and the
+    slope from each point to the next.
+    """
+    x = np.arange(zero_crossings * resolution + 2) / resolution
+    window = np.i0(beta * np.sqrt(np.clip(1.0 - (x / zero_crossings)**2, 0.0, None)))
+    table = np.sinc(x) * window / np.i0(beta)
+    table[x >= zero_crossings] = 0.0
+    return table, np.append(np.diff(table), 0.0)
+
+
+class StreamingResampler:
+    """
+    Windowed-sinc resampler for block-wise streaming.
+
+    Parameters
+    ----------
+    ratio : float
+        Initial output rate divided by input rate.
+    max_block_size : int
+        Largest input block passed to ``process``.
+    ratio_range : tuple of float, optional
+        Lowest and highest ratio that ``process`` may be asked for; the lowest fixes the
+        kernel length and the highest the size of the output buffer. Defaults to
+        ``(ratio, ratio)``.
+    zero_crossings : int, optional
+        Half-width of the kernel in zero crossings of the sinc.
+    table_resolution : int, optional
+        Kernel table points per zero crossing.
+    cutoff : float, optional
+        Cutoff as a fraction of the lower of the two Nyquist frequencies.
+    beta : float, optional
+        Kaiser window parameter.
+    """
+
+    def __init__(self, ratio, max_block_size, ratio_range=None, zero_crossings=16,
+                 table_resolution=512, cutoff=0.95, beta=8.0):
+        low, high = (ratio, ratio) if ratio_range is None else ratio_range
+        if not 0.0 < low <= ratio <= high:
+            raise ValueError("ratio must lie within a positive ratio_range")
+        self.ratio = float(ratio)
+        self.ratio_range = (float(low), float(high))
+        self.max_block_size = int(max_block_size)
+        self.zero_crossings = int(zero_crossings)
+        self.resolution = int(table_resolution)
+        self.cutoff = float(cutoff)
+
+        self.table, self.slopes = kaiser_sinc_table(self.zero_crossings, self.resolution, beta)
+
+        # Taps on each side of the read position at the lowest (most stretched) ratio
+        self.half_width = int(np.ceil(self.zero_crossings / self._scale(low)))
+        self.offsets = np.arange(-self.half_width + 1, self.half_width + 1)
+        width = 2 * self.half_width
+        self.buffer = np.zeros(width + self.max_block_size + 1)
+        max_outputs = int(np.ceil((self.max_block_size + 1) * high)) + 2
+        self.output = np.zeros(max_outputs)
+        self.reset()
+
+    def _scale(self, ratio):
+        """Kernel compression: 1 when upsampling, the ratio when downsampling."""
+        return self.cutoff * min(1.0, ratio)
+
+    @property
+    def latency(self):
+        """Delay in input samples: an output needs this many input samples after it."""
+        return self.half_width
+
+    def reset(self):
+        """Clear the history; the next input sample is aligned with the next output."""
+        self.buffer[:] = 0.0
+        # Buffer index of the next output's read position and number of valid samples;
+        # the history before it is zero.
+        self.position = float(self.half_width - 1)
+        self.filled = self.half_width - 1
+
+    @staticmethod
+    def _distances(k, a, b):
+        """Distance in input samples from the current position to the k-th next output."""
+        if abs(b) < 1e-15:
+            return a * k
+        return a * np.expm1(k * np.log1p(b)) / b
+
+    def process(self, block, ratio=None):
+        """
+        Convert one input block.
+
+        Parameters
+        ----------
+        block : array_like
+            Up to ``max_block_size`` input samples.
+        ratio : float, optional
+            Ratio to reach by the end of the block; the ratio glides linearly from the
+            current one across the block's output samples. Defaults to the current ratio.
+
+        Returns
+        -------
+        numpy.ndarray
+            The output samples that became computable (a view into an internal buffer).
+        """
+        block = np.asarray(block, dtype=np.float64)
+        count = block.size
+        if count > self.max_block_size:
+            raise ValueError(f"Block of {count} samples exceeds max_block_size")
+        target = self.ratio if ratio is None else float(ratio)
+        if not self.ratio_range[0] <= target <= self.ratio_range[1]:
+            raise ValueError(f"Ratio {target} is outside ratio_range {self.ratio_range}")
+        self.buffer[self.filled:self.filled + count] = block
+        self.filled += count
+
+        # Outputs whose kernel is fully covered: position + half_width < filled
+        last = self.filled - 1 - self.half_width
+        # The step (input samples per output) glides linearly in input time across the
+        # block, s(d) = a + b d at distance d from the current position, so the k-th
+        # position has the closed form d_k = a ((1 + b)^k - 1) / b.
+        a, end_step = 1.0 / self.ratio, 1.0 / target
+        b = (end_step - a) / max(count, 1)
+        estimate = int(np.floor((last - self.position) / min(a, end_step))) + 2
+        estimate = min(max(estimate, 0), self.output.size)
+        distances = self._distances(np.arange(estimate), a, b)
+        outputs = int(np.searchsorted(distances, last - self.position, side="right"))
+
+        result = self.output[:outputs]
+        if outputs:
+            distances = distances[:outputs]
+            positions = self.position + distances
+            scales = self.cutoff * np.minimum(1.0, 1.0 / (a + b * distances))
+            bases = np.floor(positions).astype(np.intp)
+            fractions = positions - bases
+            # Table coordinate of every tap of every output, then linear interpolation
+            table_position = (np.abs(self.offsets[None, :] - fractions[:, None])
+                              * (scales * self.resolution)[:, None])
+            index = np.minimum(table_position.astype(np.intp), self.table.size - 1)
+            weights = self.table[index] + (table_position - index) * self.slopes[index]
+            windows = sliding_window_view(self.buffer[:self.filled], self.offsets.size)
+            np.einsum("kt,kt->k", windows[bases - self.half_width + 1], weights, out=result)
+            result *= scales
+        travelled = float(self._distances(np.array([outputs]), a, b)[0])
+        self.position += travelled
+        step = np.clip(a + b * travelled, min(a, end_step), max(a, end_step))
+        self.ratio = 1.0 / step
+
+        # Drop input that no future output can reach
+        keep_from = max(int(np.floor(self.position)) - self.half_width + 1, 0)
+        kept = self.filled - keep_from
+        self.buffer[:kept] = self.buffer[keep_from:self.filled]
+        self.filled = kept
+        self.position -= keep_from
+        return result
+
+
+def resample(signal, input_rate, output_rate, block_size=4096, **options):
+    """
+    Convert a whole signal between two rates with ``StreamingResampler``.
+
+    The converter's latency is removed and the input is flushed with zeros, so the result
+    has ``round(len(signal) * output_rate / input_rate)`` samples aligned with the input.
+    """
+    signal = np.asarray(signal, dtype=np.float64)
+    ratio = output_rate / input_rate
+    converter = StreamingResampler(ratio, block_size, **options)
+    flush = np.zeros(converter.latency + 1)
+    padded = np.concatenate([signal, flush])
+    pieces = [converter.process(padded[start:start + block_size]).copy()
+              for start in range(0, padded.size, block_size)]
+    return np.concatenate(pieces)[:int(round(signal.size * ratio))]